@@ -0,0 +1,306 @@
+#ifndef DelphesReader_h
+#define DelphesReader_h
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TClonesArray.h"
+#include "TRefArray.h"
+#include "TTree.h"
+#include "TTreeReader.h"
+#include "TTreeReaderArray.h"
+#include "classes/DelphesClasses.h"
+#include "ExRootAnalysis/ExRootTreeReader.h"
+#include "JetSources.h"
+
+// Event-by-event access to the jets of one or more jet collections of a Delphes tree and their constituents, as used
+// by the analyzer; every entry is read once for all collections. `collection` indexes the jet branches passed to
+// the constructor.
+class DelphesReader {
+public:
+    virtual ~DelphesReader() {}
+
+    virtual void ReadEntry(Long64_t entry) = 0;
+
+    virtual size_t nJets(size_t collection) const = 0;
+
+    virtual float jetPt(size_t collection, size_t iJet) const = 0;
+
+    // Copy the kinematics and the selected constituents of jet `iJet` of the current entry (see collectConstituents())
+    virtual void collectConstituents(size_t collection, size_t iJet, JetConstituents &out) = 0;
+
+    // Whether readers of the same file on different threads have to be serialized
+    virtual bool needsLock() const = 0;
+    // Number of constituent references not found among the read candidates, skipped by collectConstituents()
+    virtual size_t nMissing() const {
+        return 0;
+    }
+};
+
+
+// Reader building the Delphes objects with ExRootTreeReader; the constituents are resolved through the TRefArray of
+// each jet, whose TProcessID object table is shared by all readers of the same file (hence needsLock())
+class ObjectDelphesReader : public DelphesReader {
+public:
+    ObjectDelphesReader(TTree *tree, const std::vector<TString> &jetBranches) : treeReader_(tree) {
+        branchVertex_ = treeReader_.UseBranch("Vertex"); // used for pileup
+        treeReader_.UseBranch("Particle");
+        treeReader_.UseBranch("ParticleFlowCandidate");
+        for (const auto &jetBranch : jetBranches) {
+            branchJets_.push_back(treeReader_.UseBranch(jetBranch));
+            if (!branchJets_.back()) {
+                throw std::runtime_error("Jet branch " + std::string(jetBranch.Data()) + " is not found");
+            }
+        }
+    }
+
+    void ReadEntry(Long64_t entry) override {
+        treeReader_.ReadEntry(entry);
+    }
+
+    size_t nJets(size_t collection) const override {
+        return branchJets_[collection]->GetEntriesFast();
+    }
+
+    float jetPt(size_t collection, size_t iJet) const override {
+        return ((const Jet *)branchJets_[collection]->At(iJet))->PT;
+    }
+
+    void collectConstituents(size_t collection, size_t iJet, JetConstituents &out) override {
+        const Vertex *pv = (branchVertex_ != nullptr) ? ((Vertex *)branchVertex_->At(0)) : nullptr;
+        ::collectConstituents((const Jet *)branchJets_[collection]->At(iJet), pv, out);
+    }
+
+    bool needsLock() const override {
+        return true;
+    }
+
+private:
+    ExRootTreeReader treeReader_;
+    TClonesArray *branchVertex_ = nullptr;
+    std::vector<TClonesArray *> branchJets_;
+};
+
+
+// Column-wise reader: only the leaves needed for the model inputs are enabled and read with TTreeReaderArray, without
+// building the Delphes objects. The jet constituents are resolved once per event from the unique IDs stored in the
+// TRefArrays to indices into the candidate arrays, so no TProcessID lookup is involved and readers on different
+// threads need no lock. Constituents are looked up among the ParticleFlowCandidate collection and, if
+// `genParticles`, the Particle collection (e.g. for generator-level jets).
+class FastDelphesReader : public DelphesReader {
+public:
+    FastDelphesReader(TTree *tree, const std::vector<TString> &jetBranches, bool genParticles = false) : reader_(tree) {
+        std::vector<TString> leaves;
+        for (const auto &jetBranch : jetBranches) {
+            if (!tree->GetBranch(jetBranch)) {
+                throw std::runtime_error("Jet branch " + std::string(jetBranch.Data()) + " is not found");
+            }
+            for (const char *leaf : {".PT", ".Eta", ".Phi", ".Mass", ".Constituents"}) {
+                leaves.push_back(jetBranch + leaf);
+            }
+        }
+        bool hasVertex = tree->GetBranch("Vertex") != nullptr;
+
+        // Disable all other branches
+        if (hasVertex) {
+            leaves.push_back("Vertex.Z");
+        }
+        std::vector<std::pair<TString, bool>> collections = {{"ParticleFlowCandidate", true}};
+        if (genParticles) {
+            collections.push_back({"Particle", false});
+        }
+        for (const auto &c : collections) {
+            for (const char *leaf : {"fUniqueID", "PT", "Eta", "Phi", "Mass", "Charge", "PID"}) {
+                leaves.push_back(c.first + "." + leaf);
+            }
+            if (c.second) {
+                for (const char *leaf : {"D0", "ErrorD0", "DZ", "ErrorDZ"}) {
+                    leaves.push_back(c.first + "." + leaf);
+                }
+            }
+        }
+        tree->SetBranchStatus("*", false);
+        for (const auto &leaf : leaves) {
+            tree->SetBranchStatus(leaf, true);
+        }
+
+        for (const auto &jetBranch : jetBranches) {
+            auto &jets = jets_.emplace_back();
+            jets.pt.reset(new TTreeReaderArray<Float_t>(reader_, jetBranch + ".PT"));
+            jets.eta.reset(new TTreeReaderArray<Float_t>(reader_, jetBranch + ".Eta"));
+            jets.phi.reset(new TTreeReaderArray<Float_t>(reader_, jetBranch + ".Phi"));
+            jets.mass.reset(new TTreeReaderArray<Float_t>(reader_, jetBranch + ".Mass"));
+            jets.constituents.reset(new TTreeReaderArray<TRefArray>(reader_, jetBranch + ".Constituents"));
+        }
+        if (hasVertex) {
+            vertexZ_.reset(new TTreeReaderArray<Float_t>(reader_, "Vertex.Z"));
+        }
+        for (const auto &c : collections) {
+            auto &cands = candidates_.emplace_back();
+            cands.uid.reset(new TTreeReaderArray<UInt_t>(reader_, c.first + ".fUniqueID"));
+            cands.pt.reset(new TTreeReaderArray<Float_t>(reader_, c.first + ".PT"));
+            cands.eta.reset(new TTreeReaderArray<Float_t>(reader_, c.first + ".Eta"));
+            cands.phi.reset(new TTreeReaderArray<Float_t>(reader_, c.first + ".Phi"));
+            cands.mass.reset(new TTreeReaderArray<Float_t>(reader_, c.first + ".Mass"));
+            cands.charge.reset(new TTreeReaderArray<Int_t>(reader_, c.first + ".Charge"));
+            cands.pid.reset(new TTreeReaderArray<Int_t>(reader_, c.first + ".PID"));
+            if (c.second) {
+                cands.d0.reset(new TTreeReaderArray<Float_t>(reader_, c.first + ".D0"));
+                cands.d0err.reset(new TTreeReaderArray<Float_t>(reader_, c.first + ".ErrorD0"));
+                cands.dz.reset(new TTreeReaderArray<Float_t>(reader_, c.first + ".DZ"));
+                cands.dzerr.reset(new TTreeReaderArray<Float_t>(reader_, c.first + ".ErrorDZ"));
+            }
+        }
+    }
+
+    void ReadEntry(Long64_t entry) override {
+        auto status = reader_.SetEntry(entry);
+        if (status != TTreeReader::kEntryValid) {
+            throw std::runtime_error("Cannot read entry " + std::to_string(entry) + " (status " + std::to_string(status) + ")");
+        }
+
+        // Map the unique IDs of the candidates to their indices; Delphes numbers the objects of a collection
+        // consecutively, so a hash map is only needed otherwise
+        for (auto &cands : candidates_) {
+            auto &uid = *cands.uid;
+            size_t n = uid.GetSize();
+            cands.firstUID = n > 0 ? (uid[0] & kUIDMask) : 0;
+            cands.consecutive = true;
+            for (size_t k = 0; k < n && cands.consecutive; k++) {
+                cands.consecutive = (uid[k] & kUIDMask) == cands.firstUID + k;
+            }
+            cands.index.clear();
+            if (!cands.consecutive) {
+                for (size_t k = 0; k < n; k++) {
+                    cands.index[uid[k] & kUIDMask] = k;
+                }
+            }
+        }
+    }
+
+    size_t nJets(size_t collection) const override {
+        return jets_[collection].pt->GetSize();
+    }
+
+    float jetPt(size_t collection, size_t iJet) const override {
+        return jets_[collection].pt->At(iJet);
+    }
+
+    void collectConstituents(size_t collection, size_t iJet, JetConstituents &out) override {
+        const auto &jets = jets_[collection];
+        out.pt = jets.pt->At(iJet);
+        out.eta = jets.eta->At(iJet);
+        out.phi = jets.phi->At(iJet);
+        out.energy = ROOT::Math::PtEtaPhiMVector(out.pt, out.eta, out.phi, jets.mass->At(iJet)).E();
+        out.hasPV = vertexZ_ && vertexZ_->GetSize() > 0;
+        out.pvZ = out.hasPV ? vertexZ_->At(0) : 0;
+
+        // Loop over all jet's constituents, keeping the ones passing the selection
+        auto &particles = out.particles;
+        particles.clear();
+        const TRefArray &refs = jets.constituents->At(iJet);
+        for (Int_t j = 0; j < refs.GetEntriesFast(); ++j) {
+            UInt_t uid = refs.GetUID(j) & kUIDMask;
+            const Candidates *cands = nullptr;
+            size_t k = 0;
+            for (const auto &c : candidates_) {
+                if (c.find(uid, k)) {
+                    cands = &c;
+                    break;
+                }
+            }
+
+            // Check if the constituent is accessible
+            if (!cands) {
+                ++nMissing_;
+                continue;
+            }
+
+            CandidateView view{cands->pt->At(k), cands->eta->At(k), cands->phi->At(k), cands->mass->At(k), cands->charge->At(k), cands->pid->At(k)};
+            ParticleInfo &p = particles.emplace_back();
+            if (!fillKinematics(p, &view)) {
+                particles.pop_back();
+                continue;
+            }
+            if (cands->d0) {
+                p.d0 = cands->d0->At(k);
+                p.d0err = cands->d0err->At(k);
+                p.dz = cands->dz->At(k);
+                p.dzerr = cands->dzerr->At(k);
+            } else {
+                p.d0 = p.d0err = p.dz = p.dzerr = 0;
+            }
+        }
+    }
+
+    bool needsLock() const override {
+        return false;
+    }
+
+    size_t nMissing() const override {
+        return nMissing_;
+    }
+
+private:
+    // Object number part of the unique ID (the upper bits hold the process ID index)
+    static constexpr UInt_t kUIDMask = 0xffffff;
+
+    // The Delphes particle fields used by fillKinematics()
+    struct CandidateView {
+        Float_t PT;
+        Float_t Eta;
+        Float_t Phi;
+        Float_t Mass;
+        Int_t Charge;
+        Int_t PID;
+    };
+
+    struct JetCollection {
+        std::unique_ptr<TTreeReaderArray<Float_t>> pt, eta, phi, mass;
+        std::unique_ptr<TTreeReaderArray<TRefArray>> constituents;
+    };
+
+    struct Candidates {
+        std::unique_ptr<TTreeReaderArray<UInt_t>> uid;
+        std::unique_ptr<TTreeReaderArray<Float_t>> pt, eta, phi, mass;
+        std::unique_ptr<TTreeReaderArray<Int_t>> charge, pid;
+        std::unique_ptr<TTreeReaderArray<Float_t>> d0, d0err, dz, dzerr; // not read for generator particles
+
+        UInt_t firstUID = 0;
+        bool consecutive = true;
+        std::unordered_map<UInt_t, size_t> index;
+
+        bool find(UInt_t id, size_t &k) const {
+            if (consecutive) {
+                k = id - firstUID;
+                return id >= firstUID && k < uid->GetSize();
+            }
+            auto iter = index.find(id);
+            if (iter == index.end()) {
+                return false;
+            }
+            k = iter->second;
+            return true;
+        }
+    };
+
+    TTreeReader reader_;
+    std::vector<JetCollection> jets_;
+    std::unique_ptr<TTreeReaderArray<Float_t>> vertexZ_;
+    std::vector<Candidates> candidates_;
+    size_t nMissing_ = 0;
+};
+
+
+std::unique_ptr<DelphesReader> makeDelphesReader(TTree *tree, const std::vector<TString> &jetBranches, bool fast) {
+    if (fast) {
+        bool genParticles = std::any_of(jetBranches.begin(), jetBranches.end(), [](const TString &b) { return b.BeginsWith("GenJet"); });
+        return std::unique_ptr<DelphesReader>(new FastDelphesReader(tree, jetBranches, genParticles));
+    }
+    return std::unique_ptr<DelphesReader>(new ObjectDelphesReader(tree, jetBranches));
+}
+
+#endif
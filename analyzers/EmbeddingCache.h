@@ -0,0 +1,284 @@
+#ifndef EmbeddingCache_h
+#define EmbeddingCache_h
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Persistent cache of model outputs, keyed by a hash of the model inputs of a jet.
+// The cache is an open-addressing hash table in a memory-mapped file, tagged with a hash of the model file: it is
+// cleared when opened with a different model. It grows (doubling, rehashed into a new file) at half occupancy.
+// One process at a time can use a cache file; threads of the process share it through one EmbeddingCache object.
+class EmbeddingCache {
+public:
+    // 128-bit key: `hash` selects the slot, `check` guards against collisions
+    struct Key {
+        uint64_t hash;
+        uint64_t check;
+    };
+
+    EmbeddingCache(std::string path, const std::string& model_path, size_t output_size, size_t capacity = 1 << 14)
+        : path_(std::move(path)), output_size_(output_size) {
+        lock_fd_ = ::open((path_ + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+        if (lock_fd_ < 0 || ::flock(lock_fd_, LOCK_EX | LOCK_NB) != 0) {
+            throw std::runtime_error("Cannot lock the embedding cache " + path_ + ", is it used by another process?");
+        }
+        model_hash_ = hash_file(model_path);
+
+        size_t n = 1;
+        while (n < capacity) {
+            n *= 2;
+        }
+        map(path_, n, false);
+        if (header_->model_hash != model_hash_ || header_->output_size != output_size_) {
+            if (header_->n_entries > 0) {
+                std::cerr << "EmbeddingCache: " << path_ << " was filled with another model, clearing it" << std::endl;
+            }
+            unmap();
+            map(path_, n, true);
+        }
+    }
+    EmbeddingCache(const EmbeddingCache&) = delete;
+    EmbeddingCache& operator=(const EmbeddingCache&) = delete;
+
+    ~EmbeddingCache() {
+        unmap();
+        ::close(lock_fd_);
+    }
+
+    // Key of `n_values` model inputs; the values are rounded to 16 significant bits, so that tiny differences (e.g.
+    // between the SIMD and scalar feature kernels) map to the same key
+    static Key make_key(const float* values, size_t n_values, Key key = {0, 0}) {
+        for (size_t i = 0; i < n_values; i++) {
+            uint32_t bits;
+            std::memcpy(&bits, values + i, sizeof(bits));
+            bits = (bits + 0x40) & ~0x7fu;
+            key.hash = mix(key.hash ^ bits);
+            key.check = mix(key.check + bits + 0x9e3779b97f4a7c15ull);
+        }
+        return key;
+    }
+
+    // Copy the `output_size` cached outputs of `key` to `output`; false if the key is not cached
+    bool find(const Key& key, float* output) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Slot* slot = lookup(key);
+        if (!slot_used(slot)) {
+            ++misses_;
+            return false;
+        }
+        std::memcpy(output, slot_values(slot), output_size_ * sizeof(float));
+        ++hits_;
+        return true;
+    }
+
+    void insert(const Key& key, const float* output) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (2 * (header_->n_entries + 1) > header_->capacity) {
+            grow();
+        }
+        Slot* slot = lookup(key);
+        if (slot_used(slot)) {
+            std::memcpy(slot_values(slot), output, output_size_ * sizeof(float));
+            return;
+        }
+        // The slot is marked used (hash set) only once its values are in the file, so that a job killed in between
+        // leaves an empty slot rather than a used one with missing outputs
+        std::memcpy(slot_values(slot), output, output_size_ * sizeof(float));
+        slot->check = key.check;
+        std::atomic_signal_fence(std::memory_order_release); // keep the compiler from moving the stores below
+        slot->hash = nonzero(key.hash);
+        ++header_->n_entries;
+    }
+
+    size_t output_size() const {
+        return output_size_;
+    }
+
+    size_t hits() const {
+        return hits_;
+    }
+
+    size_t misses() const {
+        return misses_;
+    }
+
+    size_t size() const {
+        return header_->n_entries;
+    }
+
+    void print_stats(std::ostream& os = std::cerr) const {
+        size_t lookups = hits_ + misses_;
+        os << "EmbeddingCache " << path_ << ": " << hits_ << " hits, " << misses_ << " misses ("
+           << (lookups ? 100. * hits_ / lookups : 0.) << "% hit rate), " << header_->n_entries << " entries" << std::endl;
+    }
+
+private:
+    static constexpr char kMagic[8] = {'S', 'O', 'P', 'H', 'E', 'M', 'B', '1'};
+
+    struct Header {
+        char magic[8];
+        uint64_t model_hash;
+        uint64_t output_size;
+        uint64_t capacity; // number of slots, a power of 2
+        uint64_t n_entries;
+    };
+
+    // followed by `output_size` floats
+    struct Slot {
+        uint64_t hash; // 0: empty
+        uint64_t check;
+    };
+
+    std::string path_;
+    size_t output_size_;
+    uint64_t model_hash_ = 0;
+    int lock_fd_ = -1;
+    int fd_ = -1;
+    size_t file_size_ = 0;
+    char* data_ = nullptr;
+    Header* header_ = nullptr;
+    std::mutex mutex_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+    }
+
+    static uint64_t nonzero(uint64_t hash) {
+        return hash ? hash : 1;
+    }
+
+    static uint64_t hash_file(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot read the model file " + path);
+        }
+        uint64_t hash = 0xcbf29ce484222325ull;
+        std::vector<char> buffer(1 << 20);
+        while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+            for (std::streamsize i = 0; i < file.gcount(); i++) {
+                hash = (hash ^ (unsigned char)buffer[i]) * 0x100000001b3ull;
+            }
+        }
+        return nonzero(hash);
+    }
+
+    size_t slot_size() const {
+        return sizeof(Slot) + output_size_ * sizeof(float);
+    }
+
+    Slot* slot_at(char* data, size_t index) const {
+        return reinterpret_cast<Slot*>(data + sizeof(Header) + index * slot_size());
+    }
+
+    float* slot_values(const Slot* slot) const {
+        return reinterpret_cast<float*>(const_cast<Slot*>(slot) + 1);
+    }
+
+    static bool slot_used(const Slot* slot) {
+        return slot->hash != 0;
+    }
+
+    // Slot of `key`, or the empty slot where it would be inserted (linear probing)
+    Slot* lookup(const Key& key) const {
+        const uint64_t hash = nonzero(key.hash);
+        const uint64_t mask = header_->capacity - 1;
+        for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+            Slot* slot = slot_at(data_, i);
+            if (!slot_used(slot) || (slot->hash == hash && slot->check == key.check)) {
+                return slot;
+            }
+        }
+    }
+
+    // Map the cache file `path`; create (or clear, if `reset`) it with `capacity` slots if it is not a valid cache
+    void map(const std::string& path, size_t capacity, bool reset) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) {
+            throw std::runtime_error("Cannot open the embedding cache " + path);
+        }
+        struct stat st;
+        ::fstat(fd_, &st);
+        Header header{};
+        bool valid = !reset && (size_t)st.st_size >= sizeof(Header) && ::pread(fd_, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                     std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.capacity > 0 &&
+                     (size_t)st.st_size == sizeof(Header) + header.capacity * (sizeof(Slot) + header.output_size * sizeof(float));
+        if (!valid) {
+            // a fresh file reads as zeros, i.e. all slots empty
+            std::memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.model_hash = model_hash_;
+            header.output_size = output_size_;
+            header.capacity = capacity;
+            header.n_entries = 0;
+            if (::ftruncate(fd_, 0) != 0 || ::ftruncate(fd_, sizeof(Header) + capacity * slot_size()) != 0 ||
+                ::pwrite(fd_, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+                throw std::runtime_error("Cannot initialize the embedding cache " + path);
+            }
+        }
+        file_size_ = sizeof(Header) + header.capacity * (sizeof(Slot) + header.output_size * sizeof(float));
+        void* data = ::mmap(nullptr, file_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Cannot map the embedding cache " + path);
+        }
+        data_ = static_cast<char*>(data);
+        header_ = reinterpret_cast<Header*>(data_);
+    }
+
+    void unmap() {
+        if (data_) {
+            ::munmap(data_, file_size_);
+            data_ = nullptr;
+            header_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    // Rehash into a file with twice the capacity, which then replaces the cache file
+    void grow() {
+        char* old_data = data_;
+        size_t old_size = file_size_;
+        size_t old_capacity = header_->capacity;
+        int old_fd = fd_;
+        data_ = nullptr;
+
+        std::string tmp_path = path_ + ".tmp";
+        map(tmp_path, 2 * old_capacity, true);
+        for (size_t i = 0; i < old_capacity; i++) {
+            const Slot* old_slot = slot_at(old_data, i);
+            if (slot_used(old_slot)) {
+                Slot* slot = lookup({old_slot->hash, old_slot->check});
+                *slot = *old_slot;
+                std::memcpy(slot_values(slot), slot_values(old_slot), output_size_ * sizeof(float));
+                ++header_->n_entries;
+            }
+        }
+        ::munmap(old_data, old_size);
+        ::close(old_fd);
+        if (::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+            throw std::runtime_error("Cannot replace the embedding cache " + path_);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef FeatureKernel_h
+#define FeatureKernel_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define FEATURE_KERNEL_AVX2 1
+#endif
+
+#include "FeatureSchema.h"
+
+// The AVX2 kernel implements the formulas of the JetClass-II schema; with another schema (FeatureSchema.h generated
+// from a different data config) only the generated scalar kernel is used
+#if defined(FEATURE_KERNEL_AVX2) && FEATURE_SCHEMA_FORMULA_HASH != 0xef89b7e06ed45341ull
+#undef FEATURE_KERNEL_AVX2
+#endif
+
+namespace feature_kernel {
+
+  // Compute the normalized inputs of the first min(jet.n_particles, length) particles of `jet` and write them into the
+  // (channel, length) rows `features`, `vectors` and `mask`. The rows must be zero-initialized: the padding entries
+  // beyond the particle count are either left untouched or overwritten with zeros.
+  typedef void (*Kernel)(const JetInputs& jet, int length, float* features, float* vectors, float* mask);
+
+  // Reference implementation, generated from the data config with the normalization constants built in
+  inline void transform_scalar(const JetInputs& jet, int length, float* features, float* vectors, float* mask) {
+    feature_schema::transform(jet, length, features, vectors, mask);
+  }
+
+#ifdef FEATURE_KERNEL_AVX2
+
+  // AVX2 implementation, 8 particles per iteration. The arithmetic (divisions, products, comparisons, clamping) is the
+  // same as in transform_scalar; log and tanh use Cephes-style polynomial approximations and hypot is sqrt(x*x + y*y).
+  // Accuracy against transform_scalar, for finite non-negative log arguments: log <= 2 ulp, tanh <= 2e-7 absolute,
+  // hypot <= 1 ulp, i.e. at most 2e-6 absolute difference on the normalized inputs. The remaining channels are identical.
+  namespace avx2 {
+
+#define FEATURE_KERNEL_TARGET __attribute__((target("avx2,fma")))
+
+    FEATURE_KERNEL_TARGET inline __m256 log_ps(__m256 x) {
+      const __m256 one = _mm256_set1_ps(1.f);
+      const __m256 zero = _mm256_setzero_ps();
+      __m256 is_zero = _mm256_cmp_ps(x, zero, _CMP_EQ_OQ);
+      __m256 is_invalid = _mm256_cmp_ps(x, zero, _CMP_NGE_UQ); // x < 0 or NaN
+      __m256 is_inf = _mm256_cmp_ps(x, _mm256_set1_ps(INFINITY), _CMP_EQ_OQ);
+
+      // x = m * 2^e with m in [0.5, 1)
+      x = _mm256_max_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x00800000))); // smallest normal
+      __m256i bits = _mm256_castps_si256(x);
+      __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+      x = _mm256_or_ps(_mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(~0x7f800000))), _mm256_set1_ps(0.5f));
+
+      // m < sqrt(1/2): use 2m - 1 and e - 1, otherwise m - 1
+      __m256 small = _mm256_cmp_ps(x, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+      e = _mm256_sub_ps(e, _mm256_and_ps(one, small));
+      x = _mm256_add_ps(_mm256_sub_ps(x, one), _mm256_and_ps(x, small));
+
+      __m256 z = _mm256_mul_ps(x, x);
+      __m256 y = _mm256_set1_ps(7.0376836292e-2f);
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-1.1514610310e-1f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.1676998740e-1f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-1.2420140846e-1f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.4249322787e-1f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-1.6668057665e-1f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(2.0000714765e-1f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-2.4999993993e-1f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(3.3333331174e-1f));
+      y = _mm256_mul_ps(_mm256_mul_ps(y, x), z);
+      y = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440e-4f), y);
+      y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+      x = _mm256_add_ps(x, y);
+      x = _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f), x);
+
+      x = _mm256_blendv_ps(x, _mm256_set1_ps(-INFINITY), is_zero);
+      x = _mm256_blendv_ps(x, _mm256_set1_ps(INFINITY), is_inf);
+      return _mm256_blendv_ps(x, _mm256_set1_ps(NAN), is_invalid);
+    }
+
+    FEATURE_KERNEL_TARGET inline __m256 exp_ps(__m256 x) {
+      x = _mm256_min_ps(x, _mm256_set1_ps(88.3762626647949f));
+      x = _mm256_max_ps(x, _mm256_set1_ps(-88.3762626647949f));
+
+      // exp(x) = 2^n * exp(r), |r| <= ln(2) / 2
+      __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f)));
+      x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+      x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+
+      __m256 z = _mm256_mul_ps(x, x);
+      __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+      y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+      y = _mm256_fmadd_ps(y, z, _mm256_add_ps(x, _mm256_set1_ps(1.f)));
+
+      __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+      return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n));
+    }
+
+    FEATURE_KERNEL_TARGET inline __m256 tanh_ps(__m256 x) {
+      const __m256 sign_mask = _mm256_set1_ps(-0.f);
+      __m256 sign = _mm256_and_ps(x, sign_mask);
+      __m256 ax = _mm256_andnot_ps(sign_mask, x);
+
+      // |x| < 0.625: odd polynomial
+      __m256 z = _mm256_mul_ps(x, x);
+      __m256 p = _mm256_set1_ps(-5.70498872745e-3f);
+      p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(2.06390887954e-2f));
+      p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-5.37397155531e-2f));
+      p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(1.33314422036e-1f));
+      p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-3.33332819422e-1f));
+      __m256 poly = _mm256_fmadd_ps(_mm256_mul_ps(p, z), x, x);
+
+      // otherwise: 1 - 2 / (exp(2|x|) + 1)
+      __m256 ex = exp_ps(_mm256_add_ps(ax, ax));
+      __m256 big = _mm256_sub_ps(_mm256_set1_ps(1.f), _mm256_div_ps(_mm256_set1_ps(2.f), _mm256_add_ps(ex, _mm256_set1_ps(1.f))));
+      big = _mm256_or_ps(big, sign);
+
+      return _mm256_blendv_ps(poly, big, _mm256_cmp_ps(ax, _mm256_set1_ps(0.625f), _CMP_GE_OQ));
+    }
+
+    FEATURE_KERNEL_TARGET inline __m256 hypot_ps(__m256 x, __m256 y) {
+      return _mm256_sqrt_ps(_mm256_fmadd_ps(x, x, _mm256_mul_ps(y, y)));
+    }
+
+    // Normalization of the flat channel `ch` (see feature_schema::kSubtract); `ch` is a constant at every call, so the
+    // channels without normalization reduce to no-ops
+    FEATURE_KERNEL_TARGET inline __m256 scale_ps(int ch, __m256 val) {
+      using namespace feature_schema;
+      if (kSubtract[ch] != 0) {
+        val = _mm256_sub_ps(val, _mm256_set1_ps(kSubtract[ch]));
+      }
+      if (kMultiply[ch] != 1) {
+        val = _mm256_mul_ps(val, _mm256_set1_ps(kMultiply[ch]));
+      }
+      if (kClipMin[ch] == -kInf && kClipMax[ch] == kInf) {
+        return val;
+      }
+      // operand order keeps NaN like std::clamp
+      val = _mm256_max_ps(_mm256_set1_ps(kClipMin[ch]), val);
+      return _mm256_min_ps(_mm256_set1_ps(kClipMax[ch]), val);
+    }
+
+    FEATURE_KERNEL_TARGET inline __m256 eq_ps(__m256 a, float b) {
+      return _mm256_and_ps(_mm256_cmp_ps(a, _mm256_set1_ps(b), _CMP_EQ_OQ), _mm256_set1_ps(1.f));
+    }
+
+    // Store the 8 channel values of particles [l, l + 8); lanes beyond the particle count are written as zero padding
+    FEATURE_KERNEL_TARGET inline void store_ps(float* row, int ch, int length, int l, __m256 val, __m256 valid) {
+      _mm256_storeu_ps(row + ch * length + l, _mm256_blendv_ps(_mm256_setzero_ps(), val, valid));
+    }
+
+    FEATURE_KERNEL_TARGET inline void transform(const JetInputs& jet, int length, float* features, float* vectors, float* mask) {
+      using feature_schema::kVectorOffset;
+      using feature_schema::kMaskOffset;
+      static_assert(kNFeatures == 17 && kNVectors == 4, "the AVX2 kernel is written for the JetClass-II channels");
+
+      int len = std::min(length, jet.n_particles);
+      if (length % 8 != 0) {
+        transform_scalar(jet, length, features, vectors, mask);
+        return;
+      }
+
+      const __m256 jet_pt = _mm256_set1_ps(jet.jet_pt);
+      const __m256 jet_energy = _mm256_set1_ps(jet.jet_energy);
+      const __m256 c500 = _mm256_set1_ps(500.f);
+      const __m256 one = _mm256_set1_ps(1.f);
+      const __m256 zero = _mm256_setzero_ps();
+      const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+
+      for (int l = 0; l < len; l += 8) { // loop over particle length
+        const __m256 valid = _mm256_cmp_ps(_mm256_add_ps(lane, _mm256_set1_ps(float(l))), _mm256_set1_ps(float(len)), _CMP_LT_OQ);
+
+        const __m256 px = _mm256_loadu_ps(jet[kPartPx] + l);
+        const __m256 py = _mm256_loadu_ps(jet[kPartPy] + l);
+        const __m256 pz = _mm256_loadu_ps(jet[kPartPz] + l);
+        const __m256 energy = _mm256_loadu_ps(jet[kPartEnergy] + l);
+        const __m256 deta = _mm256_loadu_ps(jet[kPartDeta] + l);
+        const __m256 dphi = _mm256_loadu_ps(jet[kPartDphi] + l);
+        const __m256 charge = _mm256_loadu_ps(jet[kPartCharge] + l);
+        const __m256 pid = _mm256_loadu_ps(jet[kPartPid] + l);
+        const __m256 abs_pid = _mm256_andnot_ps(_mm256_set1_ps(-0.f), pid);
+
+        // calculating new features
+        const __m256 px_scale = _mm256_mul_ps(_mm256_div_ps(px, jet_pt), c500);
+        const __m256 py_scale = _mm256_mul_ps(_mm256_div_ps(py, jet_pt), c500);
+        const __m256 pz_scale = _mm256_mul_ps(_mm256_div_ps(pz, jet_pt), c500);
+        const __m256 energy_scale = _mm256_mul_ps(_mm256_div_ps(energy, jet_pt), c500);
+        const __m256 pt = hypot_ps(px, py);
+        const __m256 pt_scale = hypot_ps(px_scale, py_scale);
+        const __m256 is_electron = eq_ps(abs_pid, 11);
+        const __m256 is_muon = eq_ps(abs_pid, 13);
+        const __m256 is_photon = eq_ps(pid, 22);
+        const __m256 is_charged = _mm256_andnot_ps(_mm256_cmp_ps(charge, zero, _CMP_EQ_OQ), one);
+        const __m256 is_neutral = _mm256_sub_ps(one, is_charged);
+
+#define SET_FEATURE(ch, val) store_ps(features, ch, length, l, scale_ps(ch, val), valid)
+        SET_FEATURE(kFeatPtScaleLog, log_ps(pt_scale));
+        SET_FEATURE(kFeatEScaleLog, log_ps(energy_scale));
+        SET_FEATURE(kFeatLogptrel, log_ps(_mm256_div_ps(pt, jet_pt)));
+        SET_FEATURE(kFeatLogerel, log_ps(_mm256_div_ps(energy, jet_energy)));
+        SET_FEATURE(kFeatDeltaR, hypot_ps(deta, dphi));
+        SET_FEATURE(kFeatCharge, charge);
+        SET_FEATURE(kFeatIsChargedHadron, _mm256_andnot_ps(_mm256_or_ps(is_electron, is_muon), is_charged));
+        SET_FEATURE(kFeatIsNeutralHadron, _mm256_andnot_ps(is_photon, is_neutral));
+        SET_FEATURE(kFeatIsPhoton, is_photon);
+        SET_FEATURE(kFeatIsElectron, is_electron);
+        SET_FEATURE(kFeatIsMuon, is_muon);
+        SET_FEATURE(kFeatD0, tanh_ps(_mm256_loadu_ps(jet[kPartD0val] + l)));
+        SET_FEATURE(kFeatD0err, _mm256_loadu_ps(jet[kPartD0err] + l));
+        SET_FEATURE(kFeatDz, tanh_ps(_mm256_loadu_ps(jet[kPartDzval] + l)));
+        SET_FEATURE(kFeatDzerr, _mm256_loadu_ps(jet[kPartDzerr] + l));
+        SET_FEATURE(kFeatDeta, deta);
+        SET_FEATURE(kFeatDphi, dphi);
+
+        store_ps(vectors, kVecPxScale, length, l, scale_ps(kVectorOffset + kVecPxScale, px_scale), valid);
+        store_ps(vectors, kVecPyScale, length, l, scale_ps(kVectorOffset + kVecPyScale, py_scale), valid);
+        store_ps(vectors, kVecPzScale, length, l, scale_ps(kVectorOffset + kVecPzScale, pz_scale), valid);
+        store_ps(vectors, kVecEnergyScale, length, l, scale_ps(kVectorOffset + kVecEnergyScale, energy_scale), valid);
+
+#undef SET_FEATURE
+
+        store_ps(mask, 0, length, l, scale_ps(kMaskOffset, one), valid);
+      }
+    }
+
+#undef FEATURE_KERNEL_TARGET
+
+  }  // namespace avx2
+
+#endif
+
+  // Pick the fastest kernel supported by the CPU. Setting the environment variable SOPHON_FEATURE_KERNEL=scalar forces
+  // the reference implementation.
+  inline Kernel select_kernel(const char** name = nullptr) {
+    const char* env = std::getenv("SOPHON_FEATURE_KERNEL");
+    bool force_scalar = env && std::strcmp(env, "scalar") == 0;
+#ifdef FEATURE_KERNEL_AVX2
+    if (!force_scalar && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      if (name) *name = "avx2";
+      return avx2::transform;
+    }
+#endif
+    if (name) *name = "scalar";
+    return transform_scalar;
+  }
+
+}  // namespace feature_kernel
+
+#endif
@@ -0,0 +1,128 @@
+// Generated by generate_schema.py from ../data/JetClassII/JetClassII_full.yaml; do not edit.
+// Model inputs (channels, normalization and derived-variable formulas) as compile-time constants.
+
+#ifndef FeatureSchema_h
+#define FeatureSchema_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "JetInputs.h"
+
+// Identifies the input channels and formulas (not the normalization), for kernels written for one schema
+#define FEATURE_SCHEMA_FORMULA_HASH 0xef89b7e06ed45341ull
+
+// Channels of the ParT inputs: pf_features (17), pf_vectors (4), pf_mask (1)
+enum FeatureChannel {
+    kFeatPtScaleLog, kFeatEScaleLog, kFeatLogptrel, kFeatLogerel, kFeatDeltaR, kFeatCharge,
+    kFeatIsChargedHadron, kFeatIsNeutralHadron, kFeatIsPhoton, kFeatIsElectron, kFeatIsMuon, kFeatD0,
+    kFeatD0err, kFeatDz, kFeatDzerr, kFeatDeta, kFeatDphi, kNFeatures
+};
+enum VectorChannel {
+    kVecPxScale, kVecPyScale, kVecPzScale, kVecEnergyScale, kNVectors
+};
+
+namespace feature_schema {
+
+  // Model input names, ordered as (features, vectors, mask)
+  constexpr const char* kInputNames[3] = {"pf_features", "pf_vectors", "pf_mask"};
+
+  // Model particle length
+  constexpr int kLength = 128;
+  static_assert(kLength <= JetInputs::kMaxParticles, "JetInputs holds fewer particles than the model length");
+
+  // Flat index of a channel: features, then vectors, then the mask
+  constexpr int kVectorOffset = kNFeatures;
+  constexpr int kMaskOffset = int(kNFeatures) + kNVectors;
+  constexpr int kNChannels = kMaskOffset + 1;
+
+  constexpr const char* kChannelNames[kNChannels] = {
+    "part_pt_scale_log", "part_e_scale_log", "part_logptrel", "part_logerel", "part_deltaR", "part_charge",
+    "part_isChargedHadron", "part_isNeutralHadron", "part_isPhoton", "part_isElectron", "part_isMuon", "part_d0",
+    "part_d0err", "part_dz", "part_dzerr", "part_deta", "part_dphi", "part_px_scale",
+    "part_py_scale", "part_pz_scale", "part_energy_scale", "part_mask"
+  };
+
+  constexpr float kInf = std::numeric_limits<float>::infinity();
+
+  // Normalization of every channel: clamp((x - subtract) * multiply, clip_min, clip_max); channels without
+  // normalization in the data config have an unbounded range
+  constexpr float kSubtract[kNChannels] = {1.7f, 2.f, -4.7f, -4.7f, 0.2f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+  constexpr float kMultiply[kNChannels] = {0.7f, 0.7f, 0.7f, 0.7f, 4.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f};
+  constexpr float kClipMin[kNChannels] = {-5.f, -5.f, -5.f, -5.f, -5.f, -kInf, -kInf, -kInf, -kInf, -kInf, -kInf, -kInf, 0.f, -kInf, 0.f, -kInf, -kInf, -kInf, -kInf, -kInf, -kInf, -kInf};
+  constexpr float kClipMax[kNChannels] = {5.f, 5.f, 5.f, 5.f, 5.f, kInf, kInf, kInf, kInf, kInf, kInf, kInf, 1.f, kInf, 1.f, kInf, kInf, kInf, kInf, kInf, kInf, kInf};
+
+  // Normalized inputs of the first min(jet.n_particles, length) particles of `jet`, written into the zero-initialized
+  // (channel, length) rows `features`, `vectors` and `mask`
+  inline void transform(const JetInputs& jet, int length, float* features, float* vectors, float* mask) {
+    const float jet_pt = jet.jet_pt;
+    const float jet_energy = jet.jet_energy;
+    const int len = std::min(length, jet.n_particles);
+    for (int l = 0; l < len; l++) { // loop over particle length
+      const float part_px = jet[kPartPx][l];
+      const float part_py = jet[kPartPy][l];
+      const float part_pz = jet[kPartPz][l];
+      const float part_energy = jet[kPartEnergy][l];
+      const float part_deta = jet[kPartDeta][l];
+      const float part_dphi = jet[kPartDphi][l];
+      const float part_charge = jet[kPartCharge][l];
+      const float part_pid = jet[kPartPid][l];
+      const float part_d0val = jet[kPartD0val][l];
+      const float part_d0err = jet[kPartD0err][l];
+      const float part_dzval = jet[kPartDzval][l];
+      const float part_dzerr = jet[kPartDzerr][l];
+
+      // new variables
+      const float part_px_scale = ((part_px / jet_pt) * 500.f);
+      const float part_py_scale = ((part_py / jet_pt) * 500.f);
+      const float part_pt_scale = std::hypot(part_px_scale, part_py_scale);
+      const float part_pt_scale_log = std::log(part_pt_scale);
+      const float part_energy_scale = ((part_energy / jet_pt) * 500.f);
+      const float part_e_scale_log = std::log(part_energy_scale);
+      const float part_pt = std::hypot(part_px, part_py);
+      const float part_logptrel = std::log((part_pt / jet_pt));
+      const float part_logerel = std::log((part_energy / jet_energy));
+      const float part_deltaR = std::hypot(part_deta, part_dphi);
+      const float part_isElectron = (std::abs(part_pid) == 11.f);
+      const float part_isMuon = (std::abs(part_pid) == 13.f);
+      const float part_isChargedHadron = (((part_charge != 0.f) && (!part_isElectron)) && (!part_isMuon));
+      const float part_isPhoton = (part_pid == 22.f);
+      const float part_isNeutralHadron = ((part_charge == 0.f) && (!part_isPhoton));
+      const float part_d0 = std::tanh(part_d0val);
+      const float part_dz = std::tanh(part_dzval);
+      const float part_pz_scale = ((part_pz / jet_pt) * 500.f);
+      const float part_mask = 1.f;
+
+      // pf_features
+      features[kFeatPtScaleLog * length + l] = std::clamp((part_pt_scale_log - 1.7f) * 0.7f, -5.f, 5.f);
+      features[kFeatEScaleLog * length + l] = std::clamp((part_e_scale_log - 2.f) * 0.7f, -5.f, 5.f);
+      features[kFeatLogptrel * length + l] = std::clamp((part_logptrel + 4.7f) * 0.7f, -5.f, 5.f);
+      features[kFeatLogerel * length + l] = std::clamp((part_logerel + 4.7f) * 0.7f, -5.f, 5.f);
+      features[kFeatDeltaR * length + l] = std::clamp((part_deltaR - 0.2f) * 4.f, -5.f, 5.f);
+      features[kFeatCharge * length + l] = part_charge;
+      features[kFeatIsChargedHadron * length + l] = part_isChargedHadron;
+      features[kFeatIsNeutralHadron * length + l] = part_isNeutralHadron;
+      features[kFeatIsPhoton * length + l] = part_isPhoton;
+      features[kFeatIsElectron * length + l] = part_isElectron;
+      features[kFeatIsMuon * length + l] = part_isMuon;
+      features[kFeatD0 * length + l] = part_d0;
+      features[kFeatD0err * length + l] = std::clamp(part_d0err, 0.f, 1.f);
+      features[kFeatDz * length + l] = part_dz;
+      features[kFeatDzerr * length + l] = std::clamp(part_dzerr, 0.f, 1.f);
+      features[kFeatDeta * length + l] = part_deta;
+      features[kFeatDphi * length + l] = part_dphi;
+      // pf_vectors
+      vectors[kVecPxScale * length + l] = part_px_scale;
+      vectors[kVecPyScale * length + l] = part_py_scale;
+      vectors[kVecPzScale * length + l] = part_pz_scale;
+      vectors[kVecEnergyScale * length + l] = part_energy_scale;
+      // pf_mask
+      mask[l] = part_mask;
+    }
+  }
+
+}  // namespace feature_schema
+
+#endif
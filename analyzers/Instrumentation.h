@@ -0,0 +1,481 @@
+#ifndef Instrumentation_h
+#define Instrumentation_h
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include <sys/resource.h>
+
+// Relaxed accumulation into an atomic double; the counters are written by one thread each and read by the
+// snapshot thread, so there is no contention
+inline void atomic_add(std::atomic<double>& a, double x) {
+    double cur = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(cur, cur + x, std::memory_order_relaxed)) {
+    }
+}
+
+// Histogram with `n_bins` equal bins in [lo, hi), linear or logarithmic, plus underflow and overflow bins.
+// Can be filled by one thread while another one reads it.
+class Histogram {
+public:
+    Histogram(std::string name, int n_bins, double lo, double hi, bool log = false)
+        : name_(std::move(name)), n_bins_(n_bins), lo_(lo), hi_(hi), log_(log), counts_(n_bins + 2) {
+        if (n_bins <= 0 || !(hi > lo) || (log && lo <= 0)) {
+            throw std::runtime_error("Invalid binning of histogram " + name_);
+        }
+        for (auto& c : counts_) {
+            c.store(0, std::memory_order_relaxed);
+        }
+        t_lo_ = log_ ? std::log(lo_) : lo_;
+        t_hi_ = log_ ? std::log(hi_) : hi_;
+    }
+
+    void fill(double x) {
+        counts_[bin(x)].fetch_add(1, std::memory_order_relaxed);
+        atomic_add(sum_, x);
+    }
+
+    // Add the contents of a histogram with the same binning
+    void add(const Histogram& other) {
+        for (size_t k = 0; k < counts_.size(); k++) {
+            counts_[k].fetch_add(other.counts_[k].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        atomic_add(sum_, other.sum_.load(std::memory_order_relaxed));
+    }
+
+    const std::string& name() const {
+        return name_;
+    }
+
+    int n_bins() const {
+        return n_bins_;
+    }
+
+    // Lower edge of bin k (0 <= k <= n_bins)
+    double edge(int k) const {
+        double t = t_lo_ + (t_hi_ - t_lo_) * k / n_bins_;
+        return log_ ? std::exp(t) : t;
+    }
+
+    // Count of bin k: 0 underflow, 1..n_bins, n_bins + 1 overflow
+    uint64_t count(int k) const {
+        return counts_[k].load(std::memory_order_relaxed);
+    }
+
+    uint64_t entries() const {
+        uint64_t n = 0;
+        for (const auto& c : counts_) {
+            n += c.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    double mean() const {
+        uint64_t n = entries();
+        return n > 0 ? sum_.load(std::memory_order_relaxed) / n : 0;
+    }
+
+    // Quantile q in [0, 1], interpolated within the bin; the underflow and overflow bins return lo and hi
+    double quantile(double q) const {
+        uint64_t n = entries();
+        if (n == 0) {
+            return 0;
+        }
+        double target = q * n, cumulative = 0;
+        for (int k = 0; k < n_bins_ + 2; k++) {
+            double c = counts_[k].load(std::memory_order_relaxed);
+            if (cumulative + c >= target && c > 0) {
+                if (k == 0) {
+                    return lo_;
+                }
+                if (k == n_bins_ + 1) {
+                    return hi_;
+                }
+                double f = (target - cumulative) / c;
+                double t = t_lo_ + (t_hi_ - t_lo_) * (k - 1 + f) / n_bins_;
+                return log_ ? std::exp(t) : t;
+            }
+            cumulative += c;
+        }
+        return hi_;
+    }
+
+private:
+    std::string name_;
+    int n_bins_;
+    double lo_, hi_, t_lo_, t_hi_;
+    bool log_;
+    std::vector<std::atomic<uint64_t>> counts_;
+    std::atomic<double> sum_{0};
+
+    int bin(double x) const {
+        if (!(x >= lo_)) {
+            return 0;
+        }
+        if (x >= hi_) {
+            return n_bins_ + 1;
+        }
+        double t = log_ ? std::log(x) : x;
+        return 1 + std::min(n_bins_ - 1, (int)((t - t_lo_) / (t_hi_ - t_lo_) * n_bins_));
+    }
+};
+
+
+// Memory use of the process: heap from malloc (glibc mallinfo2) and the peak resident set size
+struct ProcessMemory {
+    int64_t heap_in_use = -1;    // bytes in allocated chunks, including the mmapped ones
+    int64_t heap_reserved = -1;  // bytes obtained from the system by malloc
+    int64_t heap_mmapped = -1;   // number of chunks allocated with mmap (large buffers)
+    int64_t max_rss_kb = -1;
+
+    static ProcessMemory sample() {
+        ProcessMemory info;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        struct mallinfo2 mi = mallinfo2();
+        info.heap_in_use = mi.uordblks + mi.hblkhd;
+        info.heap_reserved = mi.arena + mi.hblkhd;
+        info.heap_mmapped = mi.hblks;
+#endif
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            info.max_rss_kb = usage.ru_maxrss;
+        }
+        return info;
+    }
+};
+
+
+// Counters of the analyzer hot path: wall time per stage, histograms of the constituents per jet and of the
+// per-jet latency (from queuing the jet for inference until its outputs are available), and event/jet counts.
+// Each worker fills its own object; the stages of a pipelined worker fill it from different threads, each stage
+// its own counters. Totals over the workers are formed with add(), also while they are being filled.
+class Instrumentation {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Stage {
+        kRead,       // ReadEntry: basket decompression and object building
+        kExtract,    // constituent extraction and selection
+        kSort,       // ordering of the constituents by pt
+        kJetInputs,  // copy of the leading constituents into JetInputs
+        kMakeInput,  // feature computation into the batch buffers (OrtHelper::make_input)
+        kRun,        // ONNX Runtime calls
+        kOutputCopy, // copy of the batch outputs into the per-jet slots
+        kFill,       // output tree filling and compression
+        kNStages
+    };
+
+    static const char* stage_name(int stage) {
+        static const char* names[kNStages] = {"read", "extract", "sort", "jet_inputs", "make_input", "run", "output_copy", "fill"};
+        return names[stage];
+    }
+
+    Instrumentation()
+        : constituents_("constituents_per_jet", 256, 0, 256), latency_("jet_latency_us", 40, 1, 1e8, /*log=*/true) {
+        for (auto& s : seconds_) {
+            s.store(0, std::memory_order_relaxed);
+        }
+        for (auto& c : calls_) {
+            c.store(0, std::memory_order_relaxed);
+        }
+    }
+    Instrumentation(const Instrumentation&) = delete;
+    Instrumentation& operator=(const Instrumentation&) = delete;
+
+    static Clock::time_point now() {
+        return Clock::now();
+    }
+
+    void add_time(Stage stage, double seconds, uint64_t calls = 1) {
+        atomic_add(seconds_[stage], seconds);
+        calls_[stage].fetch_add(calls, std::memory_order_relaxed);
+    }
+
+    // Add the time since `start` to `stage` and return the current time, to time consecutive stages
+    Clock::time_point mark(Stage stage, Clock::time_point start) {
+        auto end = Clock::now();
+        add_time(stage, std::chrono::duration<double>(end - start).count());
+        return end;
+    }
+
+    void add_event(size_t n_jets) {
+        n_events_.fetch_add(1, std::memory_order_relaxed);
+        n_jets_.fetch_add(n_jets, std::memory_order_relaxed);
+    }
+
+    void fill_constituents(size_t n) {
+        constituents_.fill(n);
+    }
+
+    void fill_latency(Clock::time_point queued, Clock::time_point done, size_t n_jets = 1) {
+        double us = std::chrono::duration<double, std::micro>(done - queued).count();
+        for (size_t j = 0; j < n_jets; j++) {
+            latency_.fill(us);
+        }
+    }
+
+    // Add the counters of another object (e.g. of a worker)
+    void add(const Instrumentation& other) {
+        for (int s = 0; s < kNStages; s++) {
+            add_time((Stage)s, other.seconds(s), other.calls(s));
+        }
+        n_events_.fetch_add(other.n_events(), std::memory_order_relaxed);
+        n_jets_.fetch_add(other.n_jets(), std::memory_order_relaxed);
+        constituents_.add(other.constituents_);
+        latency_.add(other.latency_);
+    }
+
+    double seconds(int stage) const {
+        return seconds_[stage].load(std::memory_order_relaxed);
+    }
+
+    uint64_t calls(int stage) const {
+        return calls_[stage].load(std::memory_order_relaxed);
+    }
+
+    uint64_t n_events() const {
+        return n_events_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t n_jets() const {
+        return n_jets_.load(std::memory_order_relaxed);
+    }
+
+    const Histogram& constituents() const {
+        return constituents_;
+    }
+
+    const Histogram& latency() const {
+        return latency_;
+    }
+
+    // Summary as one line of JSON; `elapsed` is the wall time of the job so far
+    std::string to_json(double elapsed, const ProcessMemory& memory) const {
+        std::ostringstream out;
+        out.precision(6);
+        out << "{\"elapsed_s\": " << elapsed << ", \"events\": " << n_events() << ", \"jets\": " << n_jets() << ", \"stages\": {";
+        for (int s = 0; s < kNStages; s++) {
+            out << (s ? ", " : "") << "\"" << stage_name(s) << "\": {\"seconds\": " << seconds(s) << ", \"calls\": " << calls(s)
+                << ", \"us_per_event\": " << per_event_us(s) << "}";
+        }
+        out << "}, \"histograms\": {";
+        const Histogram* histograms[] = {&constituents_, &latency_};
+        for (int h = 0; h < 2; h++) {
+            const Histogram& hist = *histograms[h];
+            out << (h ? ", " : "") << "\"" << hist.name() << "\": {\"entries\": " << hist.entries() << ", \"mean\": " << hist.mean()
+                << ", \"p50\": " << hist.quantile(0.5) << ", \"p90\": " << hist.quantile(0.9) << ", \"p99\": " << hist.quantile(0.99)
+                << ", \"edges\": [";
+            for (int k = 0; k <= hist.n_bins(); k++) {
+                out << (k ? ", " : "") << hist.edge(k);
+            }
+            out << "], \"counts\": [";
+            for (int k = 0; k < hist.n_bins() + 2; k++) {
+                out << (k ? ", " : "") << hist.count(k);
+            }
+            out << "]}";
+        }
+        out << "}, \"memory\": {\"heap_in_use_bytes\": " << memory.heap_in_use << ", \"heap_reserved_bytes\": " << memory.heap_reserved
+            << ", \"heap_mmapped_chunks\": " << memory.heap_mmapped << ", \"max_rss_kb\": " << memory.max_rss_kb << "}}";
+        return out.str();
+    }
+
+    // Summary as CSV rows "elapsed_s,section,name,key,value" (see csv_header()); histogram bins have the key
+    // "bin_<k>" with k = 0 the underflow and n_bins + 1 the overflow bin, and "edge_<k>" their lower edges
+    std::string to_csv(double elapsed, const ProcessMemory& memory) const {
+        std::ostringstream out;
+        out.precision(12); // counts without exponent
+        auto row = [&](const char* section, const std::string& name, const std::string& key, double value) {
+            out << elapsed << "," << section << "," << name << "," << key << "," << value << "\n";
+        };
+        row("job", "all", "events", n_events());
+        row("job", "all", "jets", n_jets());
+        for (int s = 0; s < kNStages; s++) {
+            row("stage", stage_name(s), "seconds", seconds(s));
+            row("stage", stage_name(s), "calls", calls(s));
+            row("stage", stage_name(s), "us_per_event", per_event_us(s));
+        }
+        for (const Histogram* hist : {&constituents_, &latency_}) {
+            row("histogram", hist->name(), "entries", hist->entries());
+            row("histogram", hist->name(), "mean", hist->mean());
+            row("histogram", hist->name(), "p50", hist->quantile(0.5));
+            row("histogram", hist->name(), "p90", hist->quantile(0.9));
+            row("histogram", hist->name(), "p99", hist->quantile(0.99));
+            for (int k = 0; k <= hist->n_bins(); k++) {
+                row("histogram", hist->name(), "edge_" + std::to_string(k + 1), hist->edge(k));
+            }
+            for (int k = 0; k < hist->n_bins() + 2; k++) {
+                row("histogram", hist->name(), "bin_" + std::to_string(k), hist->count(k));
+            }
+        }
+        row("memory", "heap", "in_use_bytes", memory.heap_in_use);
+        row("memory", "heap", "reserved_bytes", memory.heap_reserved);
+        row("memory", "heap", "mmapped_chunks", memory.heap_mmapped);
+        row("memory", "process", "max_rss_kb", memory.max_rss_kb);
+        return out.str();
+    }
+
+    static const char* csv_header() {
+        return "elapsed_s,section,name,key,value\n";
+    }
+
+    // Table of the stage times for the job log
+    void print(std::ostream& out, double elapsed) const {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-12s %12s %12s %14s\n", "stage", "seconds", "calls", "us/event");
+        out << line;
+        for (int s = 0; s < kNStages; s++) {
+            std::snprintf(line, sizeof(line), "%-12s %12.3f %12llu %14.2f\n", stage_name(s), seconds(s), (unsigned long long)calls(s), per_event_us(s));
+            out << line;
+        }
+        std::snprintf(line, sizeof(line), "%llu events, %llu jets in %.1f s; constituents per jet: mean %.1f, p99 %.0f; "
+                      "jet latency: p50 %.0f us, p99 %.0f us\n", (unsigned long long)n_events(), (unsigned long long)n_jets(), elapsed,
+                      constituents_.mean(), constituents_.quantile(0.99), latency_.quantile(0.5), latency_.quantile(0.99));
+        out << line;
+    }
+
+private:
+    std::atomic<double> seconds_[kNStages];
+    std::atomic<uint64_t> calls_[kNStages];
+    std::atomic<uint64_t> n_events_{0};
+    std::atomic<uint64_t> n_jets_{0};
+    Histogram constituents_;
+    Histogram latency_;
+
+    double per_event_us(int stage) const {
+        return n_events() > 0 ? seconds(stage) * 1e6 / n_events() : 0;
+    }
+};
+
+
+// Writes the totals of a set of Instrumentation objects: the summary at the end of the job to `path` (CSV if it
+// ends with ".csv", JSON otherwise) and snapshots to "<stem>.snapshots.csv" or "<stem>.snapshots.jsonl", one per
+// snapshot() call or every `interval` seconds after start_snapshots(). Nothing is written if `path` is empty.
+class InstrumentationReport {
+public:
+    InstrumentationReport(std::string path, std::vector<const Instrumentation*> sources)
+        : path_(std::move(path)), sources_(std::move(sources)), start_(Instrumentation::now()) {
+        csv_ = path_.size() >= 4 && path_.compare(path_.size() - 4, 4, ".csv") == 0;
+    }
+    InstrumentationReport(const InstrumentationReport&) = delete;
+    InstrumentationReport& operator=(const InstrumentationReport&) = delete;
+
+    ~InstrumentationReport() {
+        stop_snapshots();
+    }
+
+    // Take a snapshot every `interval` seconds on a background thread, until stop_snapshots(). The snapshot file is
+    // opened here, so that an error is thrown to the caller rather than on the background thread.
+    void start_snapshots(double interval) {
+        if (path_.empty() || interval <= 0 || snapshot_thread_.joinable()) {
+            return;
+        }
+        open_snapshots();
+        stop_ = false;
+        snapshot_thread_ = std::thread([this, interval]() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_cv_.wait_for(lock, std::chrono::duration<double>(interval), [this]() { return stop_; })) {
+                snapshot();
+            }
+        });
+    }
+
+    void stop_snapshots() {
+        if (!snapshot_thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        stop_cv_.notify_all();
+        snapshot_thread_.join();
+    }
+
+    double elapsed() const {
+        return std::chrono::duration<double>(Instrumentation::now() - start_).count();
+    }
+
+    // Sum of the sources
+    std::unique_ptr<Instrumentation> total() const {
+        std::unique_ptr<Instrumentation> sum(new Instrumentation);
+        for (const auto* source : sources_) {
+            sum->add(*source);
+        }
+        return sum;
+    }
+
+    void snapshot() {
+        if (path_.empty()) {
+            return;
+        }
+        open_snapshots();
+        write(*snapshots_);
+        snapshots_->flush();
+    }
+
+    void write_summary() {
+        if (path_.empty()) {
+            return;
+        }
+        std::ofstream out(path_);
+        if (!out) {
+            throw std::runtime_error("Cannot write " + path_);
+        }
+        if (csv_) {
+            out << Instrumentation::csv_header();
+        }
+        write(out);
+    }
+
+private:
+    std::string path_;
+    std::vector<const Instrumentation*> sources_;
+    Instrumentation::Clock::time_point start_;
+    bool csv_ = false;
+    std::unique_ptr<std::ofstream> snapshots_;
+    std::thread snapshot_thread_;
+    std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+
+    void open_snapshots() {
+        if (snapshots_) {
+            return;
+        }
+        std::string stem = path_.substr(0, path_.rfind('.') == std::string::npos ? path_.size() : path_.rfind('.'));
+        std::string snapshot_path = stem + (csv_ ? ".snapshots.csv" : ".snapshots.jsonl");
+        std::unique_ptr<std::ofstream> snapshots(new std::ofstream(snapshot_path));
+        if (!*snapshots) {
+            throw std::runtime_error("Cannot write " + snapshot_path);
+        }
+        if (csv_) {
+            *snapshots << Instrumentation::csv_header();
+        }
+        snapshots_ = std::move(snapshots);
+    }
+
+    void write(std::ostream& out) const {
+        auto sum = total();
+        double t = elapsed();
+        if (csv_) {
+            out << sum->to_csv(t, ProcessMemory::sample());
+        } else {
+            out << sum->to_json(t, ProcessMemory::sample()) << "\n";
+        }
+    }
+};
+
+#endif
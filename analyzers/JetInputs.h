@@ -0,0 +1,61 @@
+#ifndef JetInputs_h
+#define JetInputs_h
+
+#include <array>
+
+// Particle-level input columns of a jet
+enum ParticleVar {
+    kPartPx,
+    kPartPy,
+    kPartPz,
+    kPartEnergy,
+    kPartDeta,
+    kPartDphi,
+    kPartCharge,
+    kPartPid,
+    kPartD0val,
+    kPartD0err,
+    kPartDzval,
+    kPartDzerr,
+    kNParticleVars
+};
+
+// Column names of the particle variables, as in the JetClass-II datasets (part_pid is derived from the type flags)
+inline const char *const kParticleVarNames[kNParticleVars] = {
+    "part_px", "part_py", "part_pz", "part_energy", "part_deta", "part_dphi",
+    "part_charge", "part_pid", "part_d0val", "part_d0err", "part_dzval", "part_dzerr"
+};
+
+// Fixed-layout (structure-of-arrays) model inputs of one jet: the jet-level variables and up to `kMaxParticles`
+// particles, ordered by decreasing pt. Particles beyond the model length are dropped when filling.
+// The buffer does not allocate, so it can be reused across jets.
+struct JetInputs {
+    static constexpr int kMaxParticles = 128;
+
+    float jet_pt = 0;
+    float jet_eta = 0;
+    float jet_phi = 0;
+    float jet_energy = 0;
+
+    int n_particles = 0;
+    std::array<std::array<float, kMaxParticles>, kNParticleVars> part{}; // (variable, particle)
+
+    void clear() {
+        n_particles = 0;
+    }
+
+    // Append a particle and return its slot index, or -1 if the jet is full
+    int add_particle() {
+        return n_particles < kMaxParticles ? n_particles++ : -1;
+    }
+
+    float* operator[](ParticleVar var) {
+        return part[var].data();
+    }
+
+    const float* operator[](ParticleVar var) const {
+        return part[var].data();
+    }
+};
+
+#endif
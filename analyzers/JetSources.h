@@ -0,0 +1,232 @@
+#ifndef JetSources_h
+#define JetSources_h
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Math/Vector4D.h"
+#include "TChain.h"
+#include "TClonesArray.h"
+#include "TFile.h"
+#include "TRandom3.h"
+#include "TString.h"
+#include "TTreeReader.h"
+#include "TTreeReaderArray.h"
+#include "TTreeReaderValue.h"
+#include "TVector2.h"
+#include "classes/DelphesClasses.h"
+#include "ExRootAnalysis/ExRootTreeReader.h"
+#include "JetInputs.h"
+#include "ParticleInfo.h"
+
+// Kinematics and selected constituents of a Delphes jet, detached from the event so that the model inputs can be
+// filled on another thread
+struct JetConstituents {
+    float pt = 0;
+    float eta = 0;
+    float phi = 0;
+    float energy = 0;
+    bool hasPV = false;
+    float pvZ = 0;
+    std::vector<ParticleInfo> particles;
+};
+
+// Copy the constituents of a Delphes jet passing the selection. Resolves the TRefArray of the jet, so it has to run
+// on the thread reading the event. `pv` (optional) is the primary vertex.
+void collectConstituents(const Jet *jet, const Vertex *pv, JetConstituents &out) {
+    out.pt = jet->PT;
+    out.eta = jet->Eta;
+    out.phi = jet->Phi;
+    out.energy = jet->P4().Energy();
+    out.hasPV = pv != nullptr;
+    out.pvZ = pv ? pv->Z : 0;
+
+    // Loop over all jet's constituents, keeping the ones passing the selection
+    auto &particles = out.particles;
+    particles.clear();
+    for (Int_t j = 0; j < jet->Constituents.GetEntriesFast(); ++j) {
+        const TObject *object = jet->Constituents.At(j);
+
+        // Check if the constituent is accessible
+        if (!object)
+        continue;
+
+        ParticleInfo &p = particles.emplace_back();
+        bool selected = false;
+        if (object->IsA() == GenParticle::Class()) {
+            selected = fillParticle(p, (GenParticle *)object);
+        } else if (object->IsA() == ParticleFlowCandidate::Class()) {
+            selected = fillParticle(p, (ParticleFlowCandidate *)object);
+        }
+        if (!selected) {
+            particles.pop_back();
+        }
+    }
+}
+
+// Fill the model inputs from the first `nSelected` collected constituents, ordered with selectLeading()
+void fillJetInputs(const JetConstituents &jet, size_t nSelected, JetInputs &inputs) {
+    inputs.clear();
+    inputs.jet_pt = jet.pt;
+    inputs.jet_eta = jet.eta;
+    inputs.jet_phi = jet.phi;
+    inputs.jet_energy = jet.energy;
+
+    for (size_t k = 0; k < nSelected; k++) {
+        const auto &p = jet.particles[k];
+        inputs.add_particle();
+        inputs[kPartPx][k] = p.px;
+        inputs[kPartPy][k] = p.py;
+        inputs[kPartPz][k] = p.pz;
+        inputs[kPartEnergy][k] = p.energy;
+        inputs[kPartDeta][k] = (jet.eta > 0 ? 1 : -1) * (p.eta - jet.eta);
+        inputs[kPartDphi][k] = deltaPhi(p.phi, jet.phi);
+        inputs[kPartCharge][k] = p.charge;
+        inputs[kPartPid][k] = p.pid;
+        inputs[kPartD0val][k] = p.d0;
+        inputs[kPartD0err][k] = p.d0err;
+        inputs[kPartDzval][k] = (jet.hasPV && p.dz != 0) ? (p.dz - jet.pvZ) : p.dz;
+        inputs[kPartDzerr][k] = p.dzerr;
+    }
+}
+
+// Fill the model inputs from the collected constituents: the leading ones in pt, up to the model length
+void fillJetInputs(JetConstituents &jet, JetInputs &inputs) {
+    fillJetInputs(jet, selectLeading(jet.particles, JetInputs::kMaxParticles), inputs);
+}
+
+// Fill the model inputs of a Delphes jet; `scratch` is reused across jets
+void fillJetInputs(const Jet *jet, const Vertex *pv, JetConstituents &scratch, JetInputs &inputs) {
+    collectConstituents(jet, pv, scratch);
+    fillJetInputs(scratch, inputs);
+}
+
+// Jets of the `jetBranch` collection of a Delphes file, up to `maxJets` (all if < 0)
+std::vector<JetInputs> loadDelphesJets(TString inputFile, TString jetBranch, Long64_t maxJets = -1) {
+    TChain chain("Delphes");
+    chain.Add(inputFile);
+    ExRootTreeReader treeReader(&chain);
+    TClonesArray *branchVertex = treeReader.UseBranch("Vertex");
+    treeReader.UseBranch("Particle");
+    treeReader.UseBranch("ParticleFlowCandidate");
+    TClonesArray *branchJet = treeReader.UseBranch(jetBranch);
+    if (!branchJet) {
+        throw std::runtime_error("Jet branch " + std::string(jetBranch.Data()) + " is not found in " + inputFile.Data());
+    }
+
+    std::vector<JetInputs> jets;
+    JetConstituents constituents;
+    for (Long64_t entry = 0; entry < treeReader.GetEntries(); ++entry) {
+        treeReader.ReadEntry(entry);
+        const Vertex *pv = (branchVertex != nullptr) ? ((Vertex *)branchVertex->At(0)) : nullptr;
+        for (Int_t i = 0; i < branchJet->GetEntriesFast(); ++i) {
+            if (maxJets >= 0 && (Long64_t)jets.size() >= maxJets) {
+                return jets;
+            }
+            fillJetInputs((Jet *)branchJet->At(i), pv, constituents, jets.emplace_back());
+        }
+    }
+    return jets;
+}
+
+// Jets of a flat tree with one entry per jet: jet_pt, jet_eta, jet_phi, jet_energy and the variable-length float
+// arrays named in kParticleVarNames, e.g. a JetClass-II parquet file converted with dump_jets.py
+std::vector<JetInputs> loadTreeJets(TString inputFile, TString treeName = "jets", Long64_t maxJets = -1) {
+    std::unique_ptr<TFile> file(TFile::Open(inputFile));
+    if (!file || file->IsZombie()) {
+        throw std::runtime_error("Cannot open " + std::string(inputFile.Data()));
+    }
+    if (!file->Get(treeName)) {
+        throw std::runtime_error("Tree " + std::string(treeName.Data()) + " is not found in " + inputFile.Data());
+    }
+    TTreeReader reader(treeName, file.get());
+    TTreeReaderValue<float> jetPt(reader, "jet_pt");
+    TTreeReaderValue<float> jetEta(reader, "jet_eta");
+    TTreeReaderValue<float> jetPhi(reader, "jet_phi");
+    TTreeReaderValue<float> jetEnergy(reader, "jet_energy");
+    std::vector<std::unique_ptr<TTreeReaderArray<float>>> partVars;
+    for (int v = 0; v < kNParticleVars; v++) {
+        partVars.emplace_back(new TTreeReaderArray<float>(reader, kParticleVarNames[v]));
+    }
+
+    std::vector<JetInputs> jets;
+    while ((maxJets < 0 || (Long64_t)jets.size() < maxJets) && reader.Next()) {
+        JetInputs &inputs = jets.emplace_back();
+        inputs.clear();
+        inputs.jet_pt = *jetPt;
+        inputs.jet_eta = *jetEta;
+        inputs.jet_phi = *jetPhi;
+        inputs.jet_energy = *jetEnergy;
+        int nParticles = std::min((int)partVars[0]->GetSize(), (int)JetInputs::kMaxParticles);
+        for (int k = 0; k < nParticles; k++) {
+            inputs.add_particle();
+            for (int v = 0; v < kNParticleVars; v++) {
+                inputs[(ParticleVar)v][k] = (*partVars[v])[k];
+            }
+        }
+    }
+    return jets;
+}
+
+// `nJets` synthetic jets with a Gaussian multiplicity distribution (mean `meanParticles`, width 40% of the mean,
+// at least one particle) and particles spread around the jet axis with an exponential pt spectrum
+std::vector<JetInputs> makeSyntheticJets(Long64_t nJets, double meanParticles = 50, UInt_t seed = 42) {
+    static const int kPids[] = {211, -211, 130, 22, 22, 11, -13};
+    TRandom3 rng(seed);
+    std::vector<JetInputs> jets(nJets);
+    JetConstituents jet;
+    for (auto &inputs : jets) {
+        jet.eta = rng.Uniform(-2.4, 2.4);
+        jet.phi = rng.Uniform(-M_PI, M_PI);
+        int nParticles = std::max(1, (int)std::lround(rng.Gaus(meanParticles, 0.4 * meanParticles)));
+
+        jet.particles.clear();
+        ROOT::Math::PtEtaPhiMVector jetP4;
+        for (int k = 0; k < nParticles; k++) {
+            ParticleInfo &p = jet.particles.emplace_back();
+            p.pt = rng.Exp(10) + 0.5;
+            p.eta = jet.eta + rng.Gaus(0, 0.2);
+            p.phi = TVector2::Phi_mpi_pi(jet.phi + rng.Gaus(0, 0.2));
+            ROOT::Math::PtEtaPhiMVector p4(p.pt, p.eta, p.phi, 0);
+            p.px = p4.Px();
+            p.py = p4.Py();
+            p.pz = p4.Pz();
+            p.energy = p4.E();
+            p.pid = kPids[rng.Integer(sizeof(kPids) / sizeof(kPids[0]))];
+            p.charge = (p.pid == 130 || p.pid == 22) ? 0 : (p.pid > 0 ? 1 : -1) * (std::abs(p.pid) == 211 ? 1 : -1);
+            p.d0 = p.charge ? rng.Gaus(0, 0.05) : 0;
+            p.d0err = p.charge ? rng.Uniform(0.01, 0.05) : 0;
+            p.dz = p.charge ? rng.Gaus(0, 0.05) : 0;
+            p.dzerr = p.charge ? rng.Uniform(0.01, 0.05) : 0;
+            jetP4 += p4;
+        }
+        jet.pt = jetP4.Pt();
+        jet.energy = jetP4.E();
+        fillJetInputs(jet, inputs);
+    }
+    return jets;
+}
+
+// Load jets from `source`:
+//   "synthetic[:<mean multiplicity>]": synthetic jets (maxJets of them, 10000 if < 0)
+//   "<file>.root": a Delphes file (jets of `jetBranch`) or a flat "jets" tree (see loadTreeJets)
+std::vector<JetInputs> loadJets(TString source, TString jetBranch = "JetPUPPIAK8", Long64_t maxJets = -1) {
+    if (source.BeginsWith("synthetic")) {
+        double meanParticles = source.Contains(":") ? TString(source(source.First(':') + 1, source.Length())).Atof() : 50;
+        return makeSyntheticJets(maxJets < 0 ? 10000 : maxJets, meanParticles);
+    }
+    bool isDelphes = false;
+    {
+        std::unique_ptr<TFile> file(TFile::Open(source));
+        if (!file || file->IsZombie()) {
+            throw std::runtime_error("Cannot open " + std::string(source.Data()));
+        }
+        isDelphes = file->Get("Delphes") != nullptr;
+    }
+    return isDelphes ? loadDelphesJets(source, jetBranch, maxJets) : loadTreeJets(source, "jets", maxJets);
+}
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef ModelOutputs_h
+#define ModelOutputs_h
+
+// Layout of the model output of one jet: the class probabilities followed by the hidden neurons (jet embedding)
+constexpr int kNProbs = 188;
+constexpr int kNHidNeurons = 128;
+
+#endif
@@ -8,12 +8,21 @@
 
 #include <vector>
 #include <map>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <memory>
 #include <cassert>
 #include <algorithm>
 #include <numeric>
 #include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <cstdio>
+#include <unistd.h>
 
 #include "onnxruntime_cxx_api.h"
 
@@ -21,9 +30,90 @@ namespace myOrt {
 
   typedef std::vector<std::vector<float>> FloatArrays;
 
+  // IEEE half-precision conversions, for models with float16 inputs/outputs (e.g. converted with keep_io_types=False).
+  // The analyzers keep all buffers in float; they are converted when passed to or read from such a model.
+  inline uint16_t floatToHalf(float value) {
+    uint32_t x;
+    std::memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t abs = x & 0x7fffffff;
+    if (abs >= 0x7f800000) {
+      // inf, or nan (keeping it a quiet nan)
+      return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 | ((abs >> 13) & 0x3ff) : 0);
+    }
+    if (abs >= 0x477ff000) {
+      // rounds to a value beyond the largest half (65504)
+      return sign | 0x7c00;
+    }
+    if (abs < 0x38800000) {
+      // subnormal half: round to nearest even at a 2^-24 step, using the float addition
+      float f;
+      uint32_t a = abs;
+      std::memcpy(&f, &a, sizeof(f));
+      f += 0.5f;
+      std::memcpy(&a, &f, sizeof(a));
+      return sign | (a - 0x3f000000);
+    }
+    // normal half: rebias the exponent and round the mantissa to nearest even
+    uint32_t odd = (abs >> 13) & 1;
+    abs += 0xc8000fff + odd;
+    return sign | (abs >> 13);
+  }
+
+  inline float halfToFloat(uint16_t value) {
+    uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    uint32_t exp = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t x;
+    if (exp == 0x1f) {
+      x = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exp != 0) {
+      x = sign | ((exp + 112) << 23) | (mantissa << 13);
+    } else {
+      // zero or subnormal: mantissa * 2^-24
+      float f = mantissa * 5.9604644775390625e-8f;
+      std::memcpy(&x, &f, sizeof(x));
+      x |= sign;
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+  }
+
+  // Session settings exposed to the analyzers
+  struct SessionConfig {
+    int intra_op_threads = 1;           // threads used within an operator (0: ORT default, one per core)
+    int inter_op_threads = 1;           // threads used across operators, only with parallel execution (0: ORT default)
+    GraphOptimizationLevel graph_optimization_level = ORT_ENABLE_ALL;
+    std::string optimized_model_path;   // if set, the optimized graph is saved next to this path and reused by later sessions
+                                        // (see optimizedModelPath)
+    bool global_thread_pool = false;    // share one intra/inter-op thread pool between all sessions of the process
+    bool mem_pattern = true;            // memory pattern planning (pre-allocation based on the first run)
+    bool cpu_mem_arena = true;          // arena allocator for CPU memory
+    std::string execution_provider = "cpu"; // cpu, dnnl (oneDNN) or openvino; falls back to cpu if not available
+  };
+
+  // Parse a comma-separated list of key=value settings into a SessionConfig, e.g.
+  // "intra=4,inter=1,opt=all,cache=model.opt.onnx,global_pool=1,mem_pattern=0,arena=0,ep=dnnl".
+  // opt: disable, basic, extended or all. Unset keys keep their default.
+  SessionConfig parseSessionConfig(const std::string& spec);
+
+  // File of the optimized graph of `model_path` under `config`: `config.optimized_model_path` with a key inserted before
+  // the extension, e.g. "model.opt.1f3c5e7a9b0d2f4e.onnx". The key hashes the model file content, the settings that shape
+  // the optimized graph (optimization level, execution provider), the ONNX Runtime version and the CPU model and
+  // features, so the graph is never reused for another model, configuration or machine type.
+  std::string optimizedModelPath(const SessionConfig& config, const std::string& model_path);
+
+  // Build the ORT session options for `config`, with `config.optimized_model_path` taken as the exact file of the
+  // optimized graph (see optimizedModelPath). If that file exists, `model_path` is replaced by it; otherwise the session
+  // saves its optimized graph to the temporary file returned in `optimized_tmp_path`, to be renamed to
+  // `config.optimized_model_path` once the session is created (so that concurrent jobs never load a partial file).
+  ::Ort::SessionOptions makeSessionOptions(const SessionConfig& config, std::string& model_path, std::string& optimized_tmp_path);
+
   class ONNXRuntime {
   public:
     ONNXRuntime(const std::string& model_path, const ::Ort::SessionOptions* session_options = nullptr);
+    ONNXRuntime(const std::string& model_path, const SessionConfig& config);
     ONNXRuntime(const ONNXRuntime&) = delete;
     ONNXRuntime& operator=(const ONNXRuntime&) = delete;
     ~ONNXRuntime();
@@ -42,6 +132,50 @@ namespace myOrt {
                     const std::vector<std::string>& output_names = {},
                     int64_t batch_size = 1) const;
 
+    // Inputs and outputs bound to caller-owned float buffers, for repeated runs without copies.
+    // A tensor is only recreated when the buffer pointer or shape of its node changes, so running again on the same
+    // buffers (refilled in place) does not allocate. Each thread needs its own Binding.
+    class Binding {
+    public:
+      // Bind the input/output node `index` (in the order of getInputNames()/getOutputNames()) to `data`,
+      // which must hold the product of `shape` floats
+      void bindInput(size_t index, float* data, const int64_t* shape, size_t rank);
+      void bindOutput(size_t index, float* data, const int64_t* shape, size_t rank);
+
+    private:
+      friend class ONNXRuntime;
+      struct Slot {
+        float* data = nullptr;
+        std::vector<int64_t> shape;
+        ::Ort::Value value{nullptr};
+        bool half = false;          // float16 node: `value` holds `half_data`, converted from/to `data` at each run
+        std::vector<uint16_t> half_data;
+      };
+
+      Binding(const ONNXRuntime& ort);
+      bool update(Slot& slot, float* data, const int64_t* shape, size_t rank);
+
+      const ONNXRuntime& ort_;
+      ::Ort::MemoryInfo memory_info_;
+      ::Ort::IoBinding io_binding_;
+      std::vector<Slot> inputs_;
+      std::vector<Slot> outputs_;
+    };
+
+    std::unique_ptr<Binding> makeBinding() const;
+
+    // Run inference on the bound buffers; the outputs are written to the bound output buffers
+    void run(Binding& binding) const;
+
+    // Whether the model takes or returns float16 tensors (the float buffers are converted at each run)
+    bool hasHalfIO() const;
+
+    // Get a list of names of all the input nodes
+    const std::vector<std::string>& getInputNames() const;
+
+    // Get the shape of an input node as declared by the model; dynamic axes are negative
+    const std::vector<int64_t>& getInputShape(const std::string& input_name) const;
+
     // Get a list of names of all the output nodes
     const std::vector<std::string>& getOutputNames() const;
 
@@ -50,40 +184,252 @@ namespace myOrt {
     const std::vector<int64_t>& getOutputShape(const std::string& output_name) const;
 
   private:
-    static const ::Ort::Env& env() {
-        static ::Ort::Env instance(ORT_LOGGING_LEVEL_ERROR, "");
-        return instance;
+    // The environment is created by the first session. Sessions with `global_thread_pool` need it to be created
+    // with the global thread pool settings, i.e. they must be the first session of the process.
+    static const ::Ort::Env& env(const SessionConfig* config = nullptr) {
+        static std::unique_ptr<::Ort::Env> instance = [config]() {
+          if (config && config->global_thread_pool) {
+            ::Ort::ThreadingOptions threading_options;
+            threading_options.SetGlobalIntraOpNumThreads(config->intra_op_threads);
+            threading_options.SetGlobalInterOpNumThreads(config->inter_op_threads);
+            global_thread_pool_ = true;
+            return std::make_unique<::Ort::Env>(threading_options, ORT_LOGGING_LEVEL_ERROR, "");
+          }
+          return std::make_unique<::Ort::Env>(ORT_LOGGING_LEVEL_ERROR, "");
+        }();
+        if (config && config->global_thread_pool && !global_thread_pool_) {
+          throw std::runtime_error("global_thread_pool requires the first ONNX Runtime session of the process to use it");
+        }
+        return *instance;
     }
+    static inline bool global_thread_pool_ = false;
+
+    void init(const std::string& model_path, const ::Ort::SessionOptions& session_options, const ::Ort::Env& env);
+
     std::unique_ptr<::Ort::Session> session_;
 
     std::vector<std::string> input_node_strings_;
     std::vector<const char*> input_node_names_;
     std::map<std::string, std::vector<int64_t>> input_node_dims_;
+    std::vector<ONNXTensorElementDataType> input_node_types_;
 
     std::vector<std::string> output_node_strings_;
     std::vector<const char*> output_node_names_;
     std::map<std::string, std::vector<int64_t>> output_node_dims_;
+    std::vector<ONNXTensorElementDataType> output_node_types_;
   };
 
 
   using namespace ::Ort;
 
+  SessionConfig parseSessionConfig(const std::string& spec) {
+    SessionConfig config;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+      if (item.empty()) {
+        continue;
+      }
+      auto pos = item.find('=');
+      if (pos == std::string::npos) {
+        throw std::runtime_error("Invalid session setting " + item + ", expected key=value");
+      }
+      std::string key = item.substr(0, pos);
+      std::string value = item.substr(pos + 1);
+      auto to_bool = [&]() { return value == "1" || value == "true" || value == "on"; };
+      if (key == "intra") {
+        config.intra_op_threads = std::stoi(value);
+      } else if (key == "inter") {
+        config.inter_op_threads = std::stoi(value);
+      } else if (key == "opt") {
+        if (value == "disable") {
+          config.graph_optimization_level = ORT_DISABLE_ALL;
+        } else if (value == "basic") {
+          config.graph_optimization_level = ORT_ENABLE_BASIC;
+        } else if (value == "extended") {
+          config.graph_optimization_level = ORT_ENABLE_EXTENDED;
+        } else if (value == "all") {
+          config.graph_optimization_level = ORT_ENABLE_ALL;
+        } else {
+          throw std::runtime_error("Invalid graph optimization level " + value + ", expected disable, basic, extended or all");
+        }
+      } else if (key == "cache") {
+        config.optimized_model_path = value;
+      } else if (key == "global_pool") {
+        config.global_thread_pool = to_bool();
+      } else if (key == "mem_pattern") {
+        config.mem_pattern = to_bool();
+      } else if (key == "arena") {
+        config.cpu_mem_arena = to_bool();
+      } else if (key == "ep") {
+        if (value != "cpu" && value != "dnnl" && value != "openvino") {
+          throw std::runtime_error("Invalid execution provider " + value + ", expected cpu, dnnl or openvino");
+        }
+        config.execution_provider = value;
+      } else {
+        throw std::runtime_error("Unknown session setting " + key);
+      }
+    }
+    return config;
+  }
+
+  std::string optimizedModelPath(const SessionConfig& config, const std::string& model_path) {
+    // FNV-1a over the model file and the settings
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&hash](const char* data, size_t size) {
+      for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ull;
+      }
+    };
+    std::ifstream model(model_path, std::ios::binary);
+    if (!model) {
+      throw std::runtime_error("Cannot read the model file " + model_path);
+    }
+    std::vector<char> buffer(1 << 20);
+    while (model.read(buffer.data(), buffer.size()) || model.gcount() > 0) {
+      add(buffer.data(), model.gcount());
+    }
+    std::string settings = std::to_string((int)config.graph_optimization_level) + "|" + config.execution_provider + "|" +
+                           OrtGetApiBase()->GetVersionString() + "|";
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+      if (line.rfind("model name", 0) == 0 || line.rfind("flags", 0) == 0) {
+        settings += line + "|";
+      }
+      if (line.empty()) {
+        break; // first processor only
+      }
+    }
+    add(settings.data(), settings.size());
+
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+    std::filesystem::path path(config.optimized_model_path);
+    std::string extension = path.has_extension() ? path.extension().string() : ".onnx";
+    return (path.parent_path() / (path.stem().string() + "." + key + extension)).string();
+  }
+
+  SessionOptions makeSessionOptions(const SessionConfig& config, std::string& model_path, std::string& optimized_tmp_path) {
+    SessionOptions sess_opts;
+
+    // threading
+    if (config.global_thread_pool) {
+      sess_opts.DisablePerSessionThreads();
+    } else {
+      sess_opts.SetIntraOpNumThreads(config.intra_op_threads);
+      sess_opts.SetInterOpNumThreads(config.inter_op_threads);
+    }
+    if (config.inter_op_threads != 1) {
+      sess_opts.SetExecutionMode(ORT_PARALLEL);
+    }
+
+    // memory
+    if (config.mem_pattern) {
+      sess_opts.EnableMemPattern();
+    } else {
+      sess_opts.DisableMemPattern();
+    }
+    if (config.cpu_mem_arena) {
+      sess_opts.EnableCpuMemArena();
+    } else {
+      sess_opts.DisableCpuMemArena();
+    }
+
+    // graph optimization, reusing the optimized model saved by a previous session with the same key
+    sess_opts.SetGraphOptimizationLevel(config.graph_optimization_level);
+    optimized_tmp_path.clear();
+    if (!config.optimized_model_path.empty()) {
+      std::error_code ec;
+      if (std::filesystem::exists(config.optimized_model_path, ec)) {
+        model_path = config.optimized_model_path;
+        sess_opts.SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+      } else {
+        optimized_tmp_path = config.optimized_model_path + ".tmp" + std::to_string(::getpid());
+        sess_opts.SetOptimizedModelFilePath(optimized_tmp_path.c_str());
+      }
+    }
+
+    // execution provider
+    if (config.execution_provider != "cpu") {
+      auto providers = GetAvailableProviders();
+      auto available = [&](const std::string& name) { return std::find(providers.begin(), providers.end(), name) != providers.end(); };
+      if (config.execution_provider == "dnnl" && available("DnnlExecutionProvider")) {
+        const auto& api = GetApi();
+        OrtDnnlProviderOptions* dnnl_options = nullptr;
+        ThrowOnError(api.CreateDnnlProviderOptions(&dnnl_options));
+        std::unique_ptr<OrtDnnlProviderOptions, decltype(api.ReleaseDnnlProviderOptions)> guard(dnnl_options, api.ReleaseDnnlProviderOptions);
+        ThrowOnError(api.SessionOptionsAppendExecutionProvider_Dnnl(sess_opts, dnnl_options));
+      } else if (config.execution_provider == "openvino" && available("OpenVINOExecutionProvider")) {
+        OrtOpenVINOProviderOptions openvino_options;
+        openvino_options.device_type = "CPU_FP32";
+        sess_opts.AppendExecutionProvider_OpenVINO(openvino_options);
+      } else {
+        std::cerr << "ONNXRuntime: execution provider " << config.execution_provider << " is not available, using cpu" << std::endl;
+      }
+    }
+
+    return sess_opts;
+  }
+
   ONNXRuntime::ONNXRuntime(const std::string& model_path, const SessionOptions* session_options) {
     // create session
     if (session_options) {
-      session_.reset(new Session(env(), model_path.c_str(), *session_options));
+      init(model_path, *session_options, env());
     } else {
       SessionOptions sess_opts;
       sess_opts.SetIntraOpNumThreads(1);
-      session_.reset(new Session(env(), model_path.c_str(), sess_opts));
+      init(model_path, sess_opts, env());
+    }
+  }
+
+  ONNXRuntime::ONNXRuntime(const std::string& model_path, const SessionConfig& config) {
+    SessionConfig session_config = config;
+    if (!config.optimized_model_path.empty()) {
+      session_config.optimized_model_path = optimizedModelPath(config, model_path);
     }
+    std::string path = model_path;
+    std::string optimized_tmp_path;
+    const auto& session_env = env(&config);
+    auto sess_opts = makeSessionOptions(session_config, path, optimized_tmp_path);
+    std::error_code ec;
+    try {
+      init(path, sess_opts, session_env);
+    } catch (...) {
+      if (!optimized_tmp_path.empty()) {
+        std::filesystem::remove(optimized_tmp_path, ec);
+      }
+      throw;
+    }
+    if (!optimized_tmp_path.empty()) {
+      // atomic on POSIX: a job loading the cache sees either no file or the complete one
+      std::filesystem::rename(optimized_tmp_path, session_config.optimized_model_path, ec);
+      if (ec) {
+        std::cerr << "ONNXRuntime: cannot save the optimized model to " << session_config.optimized_model_path << ": " << ec.message() << std::endl;
+        std::filesystem::remove(optimized_tmp_path, ec);
+      }
+    }
+  }
+
+  ONNXRuntime::~ONNXRuntime() {}
+
+  void ONNXRuntime::init(const std::string& model_path, const SessionOptions& session_options, const Env& env) {
+    session_.reset(new Session(env, model_path.c_str(), session_options));
     AllocatorWithDefaultOptions allocator;
 
+    auto check_type = [](const std::string& name, ONNXTensorElementDataType type) {
+      if (type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT && type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+        throw std::runtime_error("Node " + name + " has the unsupported element type " + std::to_string(type) + ", expected float or float16");
+      }
+      return type;
+    };
+
     // get input names and shapes
     size_t num_input_nodes = session_->GetInputCount();
     input_node_strings_.resize(num_input_nodes);
     input_node_names_.resize(num_input_nodes);
     input_node_dims_.clear();
+    input_node_types_.resize(num_input_nodes);
 
     for (size_t i = 0; i < num_input_nodes; i++) {
       // get input node names
@@ -95,12 +441,14 @@ namespace myOrt {
       auto type_info = session_->GetInputTypeInfo(i);
       auto tensor_info = type_info.GetTensorTypeAndShapeInfo();
       input_node_dims_[input_name] = tensor_info.GetShape();
+      input_node_types_[i] = check_type(input_name, tensor_info.GetElementType());
     }
 
     size_t num_output_nodes = session_->GetOutputCount();
     output_node_strings_.resize(num_output_nodes);
     output_node_names_.resize(num_output_nodes);
     output_node_dims_.clear();
+    output_node_types_.resize(num_output_nodes);
 
     for (size_t i = 0; i < num_output_nodes; i++) {
       // get output node names
@@ -112,6 +460,7 @@ namespace myOrt {
       auto type_info = session_->GetOutputTypeInfo(i);
       auto tensor_info = type_info.GetTensorTypeAndShapeInfo();
       output_node_dims_[output_name] = tensor_info.GetShape();
+      output_node_types_[i] = check_type(output_name, tensor_info.GetElementType());
 
       // the 0th dim depends on the batch size
       output_node_dims_[output_name].at(0) = -1;
@@ -129,8 +478,10 @@ namespace myOrt {
 
     // create input tensor objects from data values
     std::vector<Value> input_tensors;
+    std::vector<std::vector<uint16_t>> half_inputs(input_node_strings_.size()); // float16 copies of the inputs
     auto memory_info = MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    for (const auto& name : input_node_strings_) {
+    for (size_t i = 0; i < input_node_strings_.size(); i++) {
+      const auto& name = input_node_strings_[i];
       auto iter = std::find(input_names.begin(), input_names.end(), name);
       if (iter == input_names.end()) {
         throw std::runtime_error("Input " + name + " is not provided!");
@@ -151,8 +502,16 @@ namespace myOrt {
             "Input array " + name + " has a wrong size of " + std::to_string(value->size()) + ", expected " + std::to_string(expected_len)
         );
       }
-      auto input_tensor =
-          Value::CreateTensor<float>(memory_info, value->data(), value->size(), input_dims.data(), input_dims.size());
+      Value input_tensor{nullptr};
+      if (input_node_types_[i] == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+        auto& half = half_inputs[i];
+        half.resize(value->size());
+        std::transform(value->begin(), value->end(), half.begin(), floatToHalf);
+        input_tensor = Value::CreateTensor(memory_info, half.data(), half.size() * sizeof(uint16_t), input_dims.data(), input_dims.size(),
+                                           ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
+      } else {
+        input_tensor = Value::CreateTensor<float>(memory_info, value->data(), value->size(), input_dims.data(), input_dims.size());
+      }
       assert(input_tensor.IsTensor());
       input_tensors.emplace_back(std::move(input_tensor));
     }
@@ -184,14 +543,95 @@ namespace myOrt {
       auto tensor_info = output_tensor.GetTensorTypeAndShapeInfo();
       auto length = tensor_info.GetElementCount();
 
-      auto floatarr = output_tensor.GetTensorMutableData<float>();
-      outputs.emplace_back(floatarr, floatarr + length);
+      if (tensor_info.GetElementType() == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16) {
+        auto halfarr = output_tensor.GetTensorMutableData<uint16_t>();
+        auto& output = outputs.emplace_back(length);
+        std::transform(halfarr, halfarr + length, output.begin(), halfToFloat);
+      } else {
+        auto floatarr = output_tensor.GetTensorMutableData<float>();
+        outputs.emplace_back(floatarr, floatarr + length);
+      }
     }
     assert(outputs.size() == run_output_node_names.size());
 
     return outputs;
   }
 
+  ONNXRuntime::Binding::Binding(const ONNXRuntime& ort)
+      : ort_(ort),
+        memory_info_(MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)),
+        io_binding_(*ort.session_),
+        inputs_(ort.input_node_strings_.size()),
+        outputs_(ort.output_node_strings_.size()) {}
+
+  bool ONNXRuntime::Binding::update(Slot& slot, float* data, const int64_t* shape, size_t rank) {
+    if (slot.data == data && slot.shape.size() == rank && std::equal(shape, shape + rank, slot.shape.begin())) {
+      return false;
+    }
+    slot.data = data;
+    slot.shape.assign(shape, shape + rank);
+    auto len = std::accumulate(shape, shape + rank, (int64_t)1, std::multiplies<int64_t>());
+    if (slot.half) {
+      slot.half_data.resize(len);
+      slot.value = Value::CreateTensor(memory_info_, slot.half_data.data(), len * sizeof(uint16_t), shape, rank, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16);
+    } else {
+      slot.value = Value::CreateTensor<float>(memory_info_, data, len, shape, rank);
+    }
+    return true;
+  }
+
+  void ONNXRuntime::Binding::bindInput(size_t index, float* data, const int64_t* shape, size_t rank) {
+    inputs_.at(index).half = ort_.input_node_types_[index] == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
+    if (update(inputs_[index], data, shape, rank)) {
+      io_binding_.BindInput(ort_.input_node_names_[index], inputs_[index].value);
+    }
+  }
+
+  void ONNXRuntime::Binding::bindOutput(size_t index, float* data, const int64_t* shape, size_t rank) {
+    outputs_.at(index).half = ort_.output_node_types_[index] == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16;
+    if (update(outputs_[index], data, shape, rank)) {
+      io_binding_.BindOutput(ort_.output_node_names_[index], outputs_[index].value);
+    }
+  }
+
+  std::unique_ptr<ONNXRuntime::Binding> ONNXRuntime::makeBinding() const {
+    return std::unique_ptr<Binding>(new Binding(*this));
+  }
+
+  void ONNXRuntime::run(Binding& binding) const {
+    assert(&binding.ort_ == this);
+    for (auto& slot : binding.inputs_) {
+      if (slot.half) {
+        std::transform(slot.data, slot.data + slot.half_data.size(), slot.half_data.begin(), floatToHalf);
+      }
+    }
+    session_->Run(RunOptions{nullptr}, binding.io_binding_);
+    for (auto& slot : binding.outputs_) {
+      if (slot.half) {
+        std::transform(slot.half_data.begin(), slot.half_data.end(), slot.data, halfToFloat);
+      }
+    }
+  }
+
+  bool ONNXRuntime::hasHalfIO() const {
+    auto is_half = [](ONNXTensorElementDataType type) { return type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16; };
+    return std::any_of(input_node_types_.begin(), input_node_types_.end(), is_half) ||
+           std::any_of(output_node_types_.begin(), output_node_types_.end(), is_half);
+  }
+
+  const std::vector<std::string>& ONNXRuntime::getInputNames() const {
+    return input_node_strings_;
+  }
+
+  const std::vector<int64_t>& ONNXRuntime::getInputShape(const std::string& input_name) const {
+    auto iter = input_node_dims_.find(input_name);
+    if (iter == input_node_dims_.end()) {
+      throw std::runtime_error("Input name " + input_name + " is invalid!");
+    } else {
+      return iter->second;
+    }
+  }
+
   const std::vector<std::string>& ONNXRuntime::getOutputNames() const {
     if (session_) {
       return output_node_strings_;
@@ -2,161 +2,513 @@
 #define OrtHelper_h
 
 #include <algorithm>
+#include <chrono>
+#include <deque>
 #include <iostream>
+#include <numeric>
 
 #include "ONNXRuntime.h"
+#include "JetInputs.h"
+#include "FeatureKernel.h"
+#include "EmbeddingCache.h"
+#include "Instrumentation.h"
 
 class OrtHelper {
 public:
-    OrtHelper(std::string model_path, bool debug = false) {
-        ort_ = std::make_unique<myOrt::ONNXRuntime>(model_path);
+    OrtHelper(std::string model_path, bool debug = false, unsigned batch_size = 1)
+        : OrtHelper(std::make_shared<myOrt::ONNXRuntime>(model_path), debug, batch_size) {}
+
+    // Create the session with the given settings (threads, graph optimization, execution provider, ...)
+    OrtHelper(std::string model_path, const myOrt::SessionConfig& session_config, bool debug = false, unsigned batch_size = 1)
+        : OrtHelper(std::make_shared<myOrt::ONNXRuntime>(model_path, session_config), debug, batch_size) {}
+
+    // Share one ONNX Runtime session between several helpers (e.g. one per thread): the session is only read
+    // from, while the batch buffers and outputs are owned by each helper.
+    OrtHelper(std::shared_ptr<myOrt::ONNXRuntime> ort, bool debug = false, unsigned batch_size = 1) {
+        ort_ = std::move(ort);
         debug_ = debug;
+        batch_size_ = std::max(batch_size, 1u);
         init_data();
     }
     ~OrtHelper() {}
 
     void infer_model(std::map<std::string, std::vector<float>>& particleVars, std::map<std::string, float>& jetVars) {
+        fill_inputs(particleVars, jetVars);
+        infer_model(jet_inputs_);
+    }
 
-        // Extract input and perform preprocessing
-        make_input(particleVars, jetVars);
-
-        // Inference via onnxruntime
-        output_ = ort_->run(input_names_, data_, input_shapes_)[0];
-        if (debug_) {
-            std::cout << "model output (size = " << output_.size() << "):\n";
-            for (auto v: output_) {
-                std::cout << v << " ";
-            }
-            std::cout << std::endl;
+    void infer_model(const JetInputs& jet) {
+        if (n_queued_ > 0) {
+            throw std::runtime_error("infer_model() called with jets still queued; call flush() first");
         }
+
+        // Run a batch of one jet and keep the result in output_
+        auto index = add_jet(jet);
+        flush();
+        output_.assign(get_output(index), get_output(index) + output_size_);
+        release(index + 1);
     }
 
     std::vector<float>& get_output() {
         return output_;
     }
 
-private:
-    std::unique_ptr<myOrt::ONNXRuntime> ort_ = nullptr;
-    std::vector<std::string> input_names_ = {"pf_features", "pf_vectors", "pf_mask"};
-    std::vector<std::vector<int64_t>> input_shapes_ = {{1, 17, 128}, {1, 4, 128}, {1, 1, 128}}; // (batch_size=1, channel, length)
-    std::vector<std::vector<std::tuple<std::string, float, float, float, float>>> input_var_info_ = {
-        // (name, subtract_val, multiply_val, clip_min, clip_max)
-        {
-            {"part_pt_scale_log", 1.7, 0.7, -5, 5},
-            {"part_e_scale_log", 2.0, 0.7, -5, 5},
-            {"part_logptrel", -4.7, 0.7, -5, 5},
-            {"part_logerel", -4.7, 0.7, -5, 5},
-            {"part_deltaR", 0.2, 4.0, -5, 5},
-            {"part_charge", 0, 1, -1e8, 1e8},
-            {"part_isChargedHadron", 0, 1, -1e8, 1e8},
-            {"part_isNeutralHadron", 0, 1, -1e8, 1e8},
-            {"part_isPhoton", 0, 1, -1e8, 1e8},
-            {"part_isElectron", 0, 1, -1e8, 1e8},
-            {"part_isMuon", 0, 1, -1e8, 1e8},
-            {"part_d0", 0, 1, -1e8, 1e8},
-            {"part_d0err", 0, 1, 0, 1},
-            {"part_dz", 0, 1, -1e8, 1e8},
-            {"part_dzerr", 0, 1, 0, 1},
-            {"part_deta", 0, 1, -1e8, 1e8},
-            {"part_dphi", 0, 1, -1e8, 1e8}
-        },
-        {
-            {"part_px_scale", 0, 1, -1e8, 1e8},
-            {"part_py_scale", 0, 1, -1e8, 1e8},
-            {"part_pz_scale", 0, 1, -1e8, 1e8},
-            {"part_energy_scale", 0, 1, -1e8, 1e8}
-        },
-        {
-            {"part_mask", 0, 1, -1e8, 1e8}
+    // Length-bucketed inference: each jet is queued in the bucket of the smallest length >= its number of particles
+    // and run at that length instead of being padded to the full model length, e.g. {32, 64, 96, 128}. The full
+    // length is always added as the last bucket. Lengths other than the full one need a model whose particle axis is
+    // dynamic; multiples of 8 keep the SIMD feature kernel. Call it while no jets are queued.
+    void set_length_buckets(std::vector<int64_t> lengths) {
+        if (n_queued_ > 0) {
+            throw std::runtime_error("set_length_buckets() called with jets still queued; call flush() first");
+        }
+        const int64_t full_length = input_shapes_[kPfFeatures][2];
+        lengths.push_back(full_length);
+        std::sort(lengths.begin(), lengths.end());
+        lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+        if (lengths.front() <= 0 || lengths.back() > full_length) {
+            throw std::runtime_error("Length buckets must be within [1, " + std::to_string(full_length) + "]");
+        }
+        if (lengths.size() > 1) {
+            for (const auto &name: input_names_) {
+                if (ort_->getInputShape(name).at(2) > 0) {
+                    throw std::runtime_error("Length buckets need a dynamic length axis, but input " + name + " has a fixed length");
+                }
+            }
+        }
+
+        buckets_.clear();
+        for (auto length: lengths) {
+            Bucket &bucket = buckets_.emplace_back();
+            bucket.length = length;
+            for (size_t i = 0; i < input_names_.size(); i++) {
+                bucket.shapes.push_back({(int64_t)batch_size_, input_shapes_[i][1], length});
+                bucket.data.emplace_back().reserve(batch_size_ * input_shapes_[i][1] * length);
+            }
+            if (fixed_output_) {
+                bucket.binding = ort_->makeBinding();
+            }
+        }
+        reserve_scored();
+    }
+
+    // Look up the outputs of each jet in `cache` (keyed by its model inputs) before queuing it for inference, and
+    // store the inferred outputs there. The cache can be shared between helpers.
+    void set_cache(std::shared_ptr<EmbeddingCache> cache) {
+        if (cache && (!fixed_output_ || cache->output_size() != output_size_)) {
+            throw std::runtime_error("The embedding cache needs a model with " + std::to_string(cache->output_size()) + " outputs per jet");
+        }
+        cache_ = std::move(cache);
+    }
+
+    // Rerun every bucket shorter than the full length padded to the full length and report outputs deviating by more
+    // than `tolerance` (all deviations in debug mode). Doubles the inference cost; meant for validation.
+    void set_padding_check(bool enable, float tolerance = 1e-3) {
+        check_padding_ = enable;
+        padding_tolerance_ = tolerance;
+    }
+
+    // Largest absolute output difference to the padded inference found by the padding check so far
+    float padding_check_max_diff() const {
+        return padding_max_diff_;
+    }
+
+    // Batched inference
+    // add_jet: preprocess one jet into the next free row of its bucket and return its global jet index (counting
+    // from 0 over the lifetime of the helper). A bucket is run automatically once it holds `batch_size` jets, or when
+    // its oldest jet holds back the outputs of too many later ones; call flush() to run all partially filled buckets
+    // (e.g. at the end of the input).
+    size_t add_jet(std::map<std::string, std::vector<float>>& particleVars, std::map<std::string, float>& jetVars) {
+        fill_inputs(particleVars, jetVars);
+        return add_jet(jet_inputs_);
+    }
+
+    size_t add_jet(const JetInputs& jet) {
+        Bucket &bucket = find_bucket(jet.n_particles);
+        make_input(jet, bucket);
+        size_t index = n_added_++;
+        done_.push_back(false);
+        if (!(cache_ && load_cached(jet, bucket, index))) {
+            bucket.jets.push_back(index);
+            ++n_queued_;
+            if (bucket.jets.size() == batch_size_) {
+                run_bucket(bucket);
+            }
+        }
+
+        // bound the number of jets whose outputs wait for an older jet in a sparsely filled bucket
+        while (n_added_ - n_scored_ > buckets_.size() * batch_size_) {
+            for (auto &b: buckets_) {
+                if (!b.jets.empty() && b.jets.front() == n_scored_) {
+                    run_bucket(b);
+                    break;
+                }
+            }
         }
+        return index;
+    }
+
+    void flush() {
+        for (auto &bucket: buckets_) {
+            run_bucket(bucket);
+        }
+    }
+
+    // Number of jets added but not inferred yet
+    size_t num_queued() const {
+        return n_queued_;
+    }
+
+    // Number of jets added so far, i.e. the index the next add_jet() returns
+    size_t num_added() const {
+        return n_added_;
+    }
+
+    // Number of jets whose outputs are available, i.e. get_output(index) is valid for index < num_scored().
+    // With several length buckets, jets can be inferred out of order; num_scored() only counts the leading ones.
+    size_t num_scored() const {
+        return n_scored_;
+    }
+
+    // Number of output values per jet (188 probabilities followed by 128 hidden neurons for Sophon)
+    size_t output_size() const {
+        return output_size_;
+    }
+
+    // Pointer to the `output_size()` model outputs of the jet returned by add_jet()
+    const float* get_output(size_t index) const {
+        if (index < n_released_ || index >= n_scored_) {
+            throw std::out_of_range("Output of jet " + std::to_string(index) + " is not available");
+        }
+        return scored_.data() + (index - n_released_) * output_size_;
+    }
+
+    // Wall time spent in the stages of add_jet() and flush(), in seconds, accumulated since the last reset_timing()
+    struct Timing {
+        double preprocess = 0; // feature computation into the batch buffers
+        double run = 0;        // ONNX Runtime calls
+        double copy = 0;       // copy of the outputs into the per-jet slots
+        size_t n_runs = 0;
+        size_t n_jets = 0;
     };
-    std::map<std::string, std::vector<float>> input_feats_;
-    std::vector<std::vector<float>> data_;
+
+    const Timing& timing() const {
+        return timing_;
+    }
+
+    void reset_timing() {
+        timing_ = Timing();
+    }
+
+    // Also record the stage times in `instrumentation` (not owned; null: disabled)
+    void set_instrumentation(Instrumentation* instrumentation) {
+        instrumentation_ = instrumentation;
+    }
+
+    // Drop the stored outputs of all jets with index < n_jets
+    void release(size_t n_jets) {
+        n_jets = std::min(n_jets, n_scored_);
+        if (n_jets <= n_released_) {
+            return;
+        }
+        scored_.erase(scored_.begin(), scored_.begin() + (n_jets - n_released_) * output_size_);
+        n_released_ = n_jets;
+    }
+
+private:
+    // Model inputs, with the channels and normalization of FeatureSchema.h
+    enum InputIndex { kPfFeatures, kPfVectors, kPfMask, kNInputs };
+
+    std::shared_ptr<myOrt::ONNXRuntime> ort_ = nullptr;
+    std::vector<std::string> input_names_ = {feature_schema::kInputNames[kPfFeatures], feature_schema::kInputNames[kPfVectors],
+                                             feature_schema::kInputNames[kPfMask]};
+    std::vector<std::vector<int64_t>> input_shapes_ = {{1, kNFeatures, feature_schema::kLength}, {1, kNVectors, feature_schema::kLength},
+                                                       {1, 1, feature_schema::kLength}}; // (batch_size=1, channel, length)
+    feature_kernel::Kernel kernel_ = nullptr;
+    const char* kernel_name_ = "";
+    JetInputs jet_inputs_; // scratch buffer for the std::map interface
+    std::vector<float> debug_data_; // scalar reference inputs, to check the kernel in debug mode
     std::vector<float> output_;
+    std::vector<float> scored_; // outputs of jets [n_released_, n_added_), valid for [n_released_, n_scored_)
+    std::deque<char> done_; // whether the jets [n_scored_, n_added_) have been inferred
+    std::vector<size_t> input_index_; // position of input_names_[i] among the model inputs
+    std::vector<int64_t> output_shape_; // (batch_size, ...) of the first model output
+    bool fixed_output_ = false; // whether the size of the first model output per jet is known in advance
+    size_t batch_size_ = 1;
+    size_t n_queued_ = 0;
+    size_t n_added_ = 0;
+    size_t n_scored_ = 0;
+    size_t n_released_ = 0;
+    size_t output_size_ = 0;
     bool debug_ = false;
+    Timing timing_;
+    Instrumentation* instrumentation_ = nullptr;
+    bool check_padding_ = false;
+    float padding_tolerance_ = 1e-3;
+    float padding_max_diff_ = 0;
+
+    // Jets queued for inference at one particle length
+    struct Bucket {
+        int64_t length = 0;
+        std::vector<std::vector<float>> data; // (n_jets, channel, length) per input, capacity for batch_size_ jets
+        std::vector<std::vector<int64_t>> shapes; // (n_jets, channel, length) per input
+        std::vector<size_t> jets; // global indices of the queued jets, increasing
+        std::unique_ptr<myOrt::ONNXRuntime::Binding> binding; // null if the output shape is not known in advance
+        std::vector<float> output; // outputs of the batch when they cannot be written into scored_ directly
+        std::vector<EmbeddingCache::Key> keys; // cache keys of the queued jets
+    };
+    std::vector<Bucket> buckets_; // ordered by increasing length, the last one has the full model length
+    std::shared_ptr<EmbeddingCache> cache_;
 
     void init_data() {
-        // initialize the data_ vector
-        for (size_t i = 0; i < input_names_.size(); i++) {
-            data_.emplace_back(input_shapes_[i][1] * input_shapes_[i][2], 0);
-        }
-        // initialize input_feats_
-        for (auto v: std::vector<std::string>({"part_deta", "part_dphi", "part_charge", "part_d0err", "part_dzerr", "part_px_scale", "part_py_scale", "part_pz_scale", "part_energy_scale", "part_pt_scale", "part_pt_scale_log", "part_e_scale_log", "part_logptrel", "part_logerel", "part_deltaR", "part_d0", "part_dz", "part_isElectron", "part_isMuon", "part_isPhoton", "part_isChargedHadron", "part_isNeutralHadron", "part_mask"})) {
-            input_feats_[v] = std::vector<float>();
-        }
-    }
-
-    void make_input(std::map<std::string, std::vector<float>>& particleVars, std::map<std::string, float>& jetVars) {
-        // make inputs for ParT with scaled features
-
-        for (auto &v: input_feats_) {
-            v.second.clear();
-        }
-
-        // fill input_feats_
-        // existing features
-        input_feats_["part_deta"].assign(particleVars["part_deta"].begin(), particleVars["part_deta"].end());
-        input_feats_["part_dphi"].assign(particleVars["part_dphi"].begin(), particleVars["part_dphi"].end());
-        input_feats_["part_charge"].assign(particleVars["part_charge"].begin(), particleVars["part_charge"].end());
-        input_feats_["part_d0err"].assign(particleVars["part_d0err"].begin(), particleVars["part_d0err"].end());
-        input_feats_["part_dzerr"].assign(particleVars["part_dzerr"].begin(), particleVars["part_dzerr"].end());
-
-        for (size_t i = 0; i < particleVars["part_px"].size(); i++) {
-            // calculating new features
-            input_feats_["part_mask"].push_back(1);
-            input_feats_["part_px_scale"].push_back(particleVars["part_px"][i] / jetVars["jet_pt"] * 500);
-            input_feats_["part_py_scale"].push_back(particleVars["part_py"][i] / jetVars["jet_pt"] * 500);
-            input_feats_["part_pz_scale"].push_back(particleVars["part_pz"][i] / jetVars["jet_pt"] * 500);
-            input_feats_["part_energy_scale"].push_back(particleVars["part_energy"][i] / jetVars["jet_pt"] * 500);
-
-            input_feats_["part_pt"].push_back(std::hypot(particleVars["part_px"][i], particleVars["part_py"][i]));
-            input_feats_["part_pt_scale"].push_back(std::hypot(input_feats_["part_px_scale"][i], input_feats_["part_py_scale"][i]));
-            input_feats_["part_pt_scale_log"].push_back(std::log(input_feats_["part_pt_scale"][i]));
-            input_feats_["part_e_scale_log"].push_back(std::log(input_feats_["part_energy_scale"][i]));
-            input_feats_["part_logptrel"].push_back(std::log(input_feats_["part_pt"][i] / jetVars["jet_pt"]));
-            input_feats_["part_logerel"].push_back(std::log(particleVars["part_energy"][i] / jetVars["jet_energy"]));
-            input_feats_["part_deltaR"].push_back(std::hypot(particleVars["part_deta"][i], particleVars["part_dphi"][i]));
-            input_feats_["part_d0"].push_back(std::tanh(particleVars["part_d0val"][i]));
-            input_feats_["part_dz"].push_back(std::tanh(particleVars["part_dzval"][i]));
-            input_feats_["part_isElectron"].push_back(particleVars["part_pid"][i] == 11 || particleVars["part_pid"][i] == -11);
-            input_feats_["part_isMuon"].push_back(particleVars["part_pid"][i] == 13 || particleVars["part_pid"][i] == -13);
-            input_feats_["part_isPhoton"].push_back(particleVars["part_pid"][i] == 22);
-            input_feats_["part_isChargedHadron"].push_back(particleVars["part_charge"][i] != 0 && !input_feats_["part_isElectron"][i] && !input_feats_["part_isMuon"][i]);
-            input_feats_["part_isNeutralHadron"].push_back(particleVars["part_charge"][i] == 0 && !input_feats_["part_isPhoton"][i]);
-        }
-
-        // reset data_ to all zeros
+        kernel_ = feature_kernel::select_kernel(&kernel_name_);
+
+        // bind the batch buffers to the session if the size of the (first) model output per jet is fixed
+        const auto &model_inputs = ort_->getInputNames();
+        for (const auto &name: input_names_) {
+            auto iter = std::find(model_inputs.begin(), model_inputs.end(), name);
+            if (iter == model_inputs.end()) {
+                throw std::runtime_error("Input " + name + " is not found in the model");
+            }
+            input_index_.push_back(iter - model_inputs.begin());
+        }
+        output_shape_ = ort_->getOutputShape(ort_->getOutputNames().at(0));
+        output_size_ = std::accumulate(output_shape_.begin() + 1, output_shape_.end(), (int64_t)1, std::multiplies<int64_t>());
+        fixed_output_ = std::all_of(output_shape_.begin() + 1, output_shape_.end(), [](int64_t d) { return d > 0; }) &&
+                        input_index_.size() == model_inputs.size();
+        if (!fixed_output_) {
+            output_size_ = 0;
+        }
+
+        // a single bucket at the full model length
+        set_length_buckets({});
+        check_padding_ = debug_;
+        if (debug_) {
+            std::cout << "feature kernel: " << kernel_name_ << std::endl;
+        }
+    }
+
+    void fill_inputs(std::map<std::string, std::vector<float>>& particleVars, std::map<std::string, float>& jetVars) {
+        // copy the string-keyed variables into jet_inputs_
+        jet_inputs_.jet_pt = jetVars["jet_pt"];
+        jet_inputs_.jet_eta = jetVars["jet_eta"];
+        jet_inputs_.jet_phi = jetVars["jet_phi"];
+        jet_inputs_.jet_energy = jetVars["jet_energy"];
+        jet_inputs_.n_particles = std::min((int)particleVars["part_px"].size(), (int)JetInputs::kMaxParticles);
+        for (int v = 0; v < kNParticleVars; v++) {
+            const auto &values = particleVars[kParticleVarNames[v]];
+            std::copy_n(values.begin(), std::min((int)values.size(), jet_inputs_.n_particles), jet_inputs_[(ParticleVar)v]);
+        }
+    }
+
+    Bucket& find_bucket(int n_particles) {
+        for (auto &bucket: buckets_) {
+            if (n_particles <= bucket.length) {
+                return bucket;
+            }
+        }
+        return buckets_.back();
+    }
+
+    void make_input(const JetInputs& jet, Bucket& bucket) {
+        // make inputs for ParT with scaled features, written straight into the next row of the bucket
+
+        // append a zero-initialized row for this jet to the bucket
+        auto start = std::chrono::steady_clock::now();
+        const size_t row = bucket.jets.size();
+        const int64_t length = bucket.length;
         for (size_t i = 0; i < input_names_.size(); i++) {
-            data_[i].assign(data_[i].size(), 0);
-        }
-        // construct the input data_
-        for (size_t i = 0; i < input_names_.size(); i++) { // loop over input names
-            for (int j = 0; j < input_shapes_[i][1]; j++) { // loop over channels
-
-                auto name = std::get<0>(input_var_info_[i][j]);
-                auto subtract_val = std::get<1>(input_var_info_[i][j]);
-                auto multiply_val = std::get<2>(input_var_info_[i][j]);
-                auto clip_min = std::get<3>(input_var_info_[i][j]);
-                auto clip_max = std::get<4>(input_var_info_[i][j]);
-                float val;
-
-                int len = std::min((int)input_shapes_[i][2], (int)input_feats_[name].size());
-                for (auto l = 0; l < len; l++) { // loop over particle length
-                    data_[i][j * input_shapes_[i][2] + l] = std::clamp((input_feats_[name][l] - subtract_val) * multiply_val, clip_min, clip_max);
-                }
+            bucket.data[i].resize((row + 1) * input_shapes_[i][1] * length, 0);
+        }
+        float *features = bucket.data[kPfFeatures].data() + row * kNFeatures * length;
+        float *vectors = bucket.data[kPfVectors].data() + row * kNVectors * length;
+        float *mask = bucket.data[kPfMask].data() + row * length;
+
+        kernel_(jet, length, features, vectors, mask);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        timing_.preprocess += seconds;
+        if (instrumentation_) {
+            instrumentation_->add_time(Instrumentation::kMakeInput, seconds);
+        }
+
+        if (debug_) {
+            // compare with the reference implementation
+            const int64_t row_size = feature_schema::kNChannels * length;
+            debug_data_.assign(row_size, 0);
+            feature_kernel::transform_scalar(jet, length, debug_data_.data(), debug_data_.data() + kNFeatures * length,
+                                             debug_data_.data() + feature_schema::kMaskOffset * length);
+            float max_diff = 0;
+            for (int64_t k = 0; k < row_size; k++) {
+                float val = k < kNFeatures * length ? features[k] : k < feature_schema::kMaskOffset * length ? vectors[k - kNFeatures * length] : mask[k - feature_schema::kMaskOffset * length];
+                max_diff = std::max(max_diff, std::abs(val - debug_data_[k]));
             }
-            if (debug_) {
-                std::cout << "input: " << input_names_[i] << ":\n";
+            std::cout << "feature kernel " << kernel_name_ << ": max deviation from scalar = " << max_diff << std::endl;
+
+            const int channel_offsets[kNInputs] = {0, feature_schema::kVectorOffset, feature_schema::kMaskOffset};
+            for (size_t i = 0; i < input_names_.size(); i++) {
+                const float *data = bucket.data[i].data() + row * input_shapes_[i][1] * length;
+                std::cout << "input: " << input_names_[i] << " (length = " << length << "):\n";
                 for (int j = 0; j < input_shapes_[i][1]; j++) {
-                    std::cout << "> var: " << std::get<0>(input_var_info_[i][j]) << ":\n";
-                    for (int k = 0; k < input_shapes_[i][2]; k++) {
-                        std::cout << data_[i][j * input_shapes_[i][2] + k] << " ";
+                    std::cout << "> var: " << feature_schema::kChannelNames[channel_offsets[i] + j] << ":\n";
+                    for (int k = 0; k < length; k++) {
+                        std::cout << data[j * length + k] << " ";
                     }
                     std::cout << std::endl;
                 }
             }
         }
+    }
+
+    // Room for the outputs of all jets that can be pending in steady state: up to batch_size_ queued jets per bucket
+    // plus the one being added (see add_jet), and one batch of scored jets not released yet. Then the resizes of
+    // scored_ in run_bucket and load_cached never reallocate as long as the caller releases its outputs in time.
+    void reserve_scored() {
+        scored_.reserve(((buckets_.size() + 1) * batch_size_ + 1) * output_size_);
+    }
+
+    void run_bucket(Bucket& bucket) {
+        const size_t n_jets = bucket.jets.size();
+        if (n_jets == 0) {
+            return;
+        }
+
+        // Inference via onnxruntime; the outputs are stored at the slots of the jets in scored_
+        for (auto &shape: bucket.shapes) {
+            shape[0] = n_jets;
+        }
+        auto start = std::chrono::steady_clock::now();
+        const float *output = nullptr;
+        bool in_place = false;
+        if (bucket.binding) {
+            // bound run: inputs read from the bucket, outputs written straight into scored_ if the jets are consecutive
+            for (size_t i = 0; i < input_names_.size(); i++) {
+                bucket.binding->bindInput(input_index_[i], bucket.data[i].data(), bucket.shapes[i].data(), bucket.shapes[i].size());
+            }
+            scored_.resize((n_added_ - n_released_) * output_size_);
+            in_place = bucket.jets.back() - bucket.jets.front() + 1 == n_jets;
+            float *dest = scored_.data() + (bucket.jets.front() - n_released_) * output_size_;
+            if (!in_place) {
+                bucket.output.resize(n_jets * output_size_);
+                dest = bucket.output.data();
+            }
+            output_shape_[0] = n_jets;
+            bucket.binding->bindOutput(0, dest, output_shape_.data(), output_shape_.size());
+            ort_->run(*bucket.binding);
+            output = dest;
+        } else {
+            bucket.output = std::move(ort_->run(input_names_, bucket.data, bucket.shapes, {}, n_jets)[0]);
+            if (output_size_ != bucket.output.size() / n_jets) {
+                output_size_ = bucket.output.size() / n_jets;
+                reserve_scored();
+            }
+            scored_.resize((n_added_ - n_released_) * output_size_);
+            output = bucket.output.data();
+        }
+        auto run_end = std::chrono::steady_clock::now();
+        if (!in_place) {
+            for (size_t k = 0; k < n_jets; k++) {
+                std::copy_n(output + k * output_size_, output_size_, scored_.data() + (bucket.jets[k] - n_released_) * output_size_);
+            }
+        }
+        double run_seconds = std::chrono::duration<double>(run_end - start).count();
+        double copy_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_end).count();
+        timing_.run += run_seconds;
+        timing_.copy += copy_seconds;
+        if (instrumentation_) {
+            instrumentation_->add_time(Instrumentation::kRun, run_seconds);
+            instrumentation_->add_time(Instrumentation::kOutputCopy, copy_seconds);
+        }
+        timing_.n_runs++;
+        timing_.n_jets += n_jets;
+        if (check_padding_ && bucket.length < input_shapes_[kPfFeatures][2]) {
+            check_padding(bucket, output);
+        }
+        if (debug_) {
+            std::cout << "model output (batch = " << n_jets << ", length = " << bucket.length << ", size = " << output_size_ << "):\n";
+            for (size_t k = 0; k < n_jets * output_size_; k++) {
+                std::cout << output[k] << " ";
+            }
+            std::cout << std::endl;
+        }
 
+        if (cache_) {
+            for (size_t k = 0; k < n_jets; k++) {
+                cache_->insert(bucket.keys[k], output + k * output_size_);
+            }
+            bucket.keys.clear();
+        }
+
+        // Mark the jets as inferred and reset the bucket
+        for (auto index: bucket.jets) {
+            done_[index - n_scored_] = true;
+        }
+        advance_scored();
+        n_queued_ -= n_jets;
+        bucket.jets.clear();
+        for (auto &d: bucket.data) {
+            d.clear();
+        }
+    }
+
+    void advance_scored() {
+        while (!done_.empty() && done_.front()) {
+            done_.pop_front();
+            ++n_scored_;
+        }
+    }
+
+    bool load_cached(const JetInputs& jet, Bucket& bucket, size_t index) {
+        // key of the inputs just written to the next row of the bucket; only the filled particles are hashed, so
+        // that the key does not depend on the bucket length
+        const size_t row = bucket.jets.size();
+        const int64_t n_particles = std::min<int64_t>(jet.n_particles, bucket.length);
+        const float n_values = n_particles;
+        EmbeddingCache::Key key = EmbeddingCache::make_key(&n_values, 1);
+        for (size_t i = 0; i < input_names_.size(); i++) {
+            const float *data = bucket.data[i].data() + row * input_shapes_[i][1] * bucket.length;
+            for (int64_t j = 0; j < input_shapes_[i][1]; j++) {
+                key = EmbeddingCache::make_key(data + j * bucket.length, n_particles, key);
+            }
+        }
+
+        scored_.resize((n_added_ - n_released_) * output_size_);
+        if (!cache_->find(key, scored_.data() + (index - n_released_) * output_size_)) {
+            bucket.keys.push_back(key);
+            return false;
+        }
+
+        // drop the row again
+        for (size_t i = 0; i < input_names_.size(); i++) {
+            bucket.data[i].resize(row * input_shapes_[i][1] * bucket.length);
+        }
+        done_.back() = true;
+        advance_scored();
+        return true;
+    }
+
+    void check_padding(const Bucket& bucket, const float* output) {
+        // rerun the jets of the bucket zero-padded to the full model length and compare the outputs
+        const size_t n_jets = bucket.jets.size();
+        myOrt::FloatArrays padded(input_names_.size());
+        std::vector<std::vector<int64_t>> shapes = input_shapes_;
+        for (size_t i = 0; i < input_names_.size(); i++) {
+            const int64_t n_rows = n_jets * input_shapes_[i][1];
+            const int64_t length = input_shapes_[i][2];
+            shapes[i][0] = n_jets;
+            padded[i].assign(n_rows * length, 0);
+            for (int64_t r = 0; r < n_rows; r++) {
+                std::copy_n(bucket.data[i].data() + r * bucket.length, bucket.length, padded[i].data() + r * length);
+            }
+        }
+        auto reference = ort_->run(input_names_, padded, shapes, {}, n_jets)[0];
+        float max_diff = 0;
+        for (size_t k = 0; k < n_jets * output_size_; k++) {
+            max_diff = std::max(max_diff, std::abs(output[k] - reference[k]));
+        }
+        padding_max_diff_ = std::max(padding_max_diff_, max_diff);
+        if (debug_ || max_diff > padding_tolerance_) {
+            std::cout << "length bucket " << bucket.length << ": max deviation from padded length " << input_shapes_[kPfFeatures][2]
+                      << " = " << max_diff << (max_diff > padding_tolerance_ ? " (above tolerance)" : "") << std::endl;
+        }
     }
 };
 
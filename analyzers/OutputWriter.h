@@ -0,0 +1,189 @@
+#ifndef OutputWriter_h
+#define OutputWriter_h
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "TObjArray.h"
+#include "TObjString.h"
+#include "TBranch.h"
+#include "TString.h"
+#include "TTree.h"
+#include "ModelOutputs.h"
+
+// Output settings of the analyzer
+// mode:
+//   "vector": one std::vector<float> branch per quantity (jet_pt, jet_probs_0..187, jet_hidneurons_0..127)
+//   "flat":   nJet plus fixed-size per-jet arrays jet_pt[nJet], jet_probs[nJet][188], jet_hidneurons[nJet][128]
+// outputs: comma-separated subset of "pt,probs,hidneurons" to store
+// hidneuronBits (flat mode only, rejected otherwise): if > 0, store the hidden neurons as Float16_t with this many mantissa
+// bits (2-14)
+struct OutputConfig {
+    TString mode = "vector";
+    TString outputs = "pt,probs,hidneurons";
+    int hidneuronBits = 0;
+
+    // Throw std::invalid_argument for settings that cannot be stored as requested
+    void check() const {
+        if (mode != "vector" && mode != "flat") {
+            throw std::invalid_argument("Unknown output mode " + std::string(mode.Data()) + ", expected vector or flat");
+        }
+        if (hidneuronBits != 0 && (mode != "flat" || hidneuronBits < 2 || hidneuronBits > 14)) {
+            throw std::invalid_argument("hidneuronBits = " + std::to_string(hidneuronBits) + " needs the flat output mode and a value from 2 to 14");
+        }
+    }
+};
+
+// Books the output branches of one jet collection and model in `tree`, named with `prefix` prepended (e.g.
+// "JetPUPPIAK15_jet_pt"); several writers can share a tree. The tree is filled by the caller, once per event.
+class OutputWriter {
+public:
+    OutputWriter(TTree *tree, const OutputConfig &config, const std::string &prefix = "") : tree_(tree), prefix_(prefix) {
+        std::unique_ptr<TObjArray> outputs(config.outputs.Tokenize(","));
+        for (const auto *obj : *outputs) {
+            TString name = ((const TObjString *)obj)->String().Strip(TString::kBoth);
+            if (name == "pt") {
+                store_pt_ = true;
+            } else if (name == "probs") {
+                store_probs_ = true;
+            } else if (name == "hidneurons") {
+                store_hidneurons_ = true;
+            } else {
+                throw std::invalid_argument("Unknown output " + std::string(name.Data()) + ", expected pt, probs or hidneurons");
+            }
+        }
+
+        config.check();
+
+        if (config.mode == "vector") {
+            flat_ = false;
+            vectors_.reserve(1 + kNProbs + kNHidNeurons); // the branches keep the addresses of the elements
+            if (store_pt_) {
+                book_vector("jet_pt");
+            }
+            if (store_probs_) {
+                for (int i = 0; i < kNProbs; i++) {
+                    book_vector("jet_probs_" + std::to_string(i));
+                }
+            }
+            if (store_hidneurons_) {
+                for (int i = 0; i < kNHidNeurons; i++) {
+                    book_vector("jet_hidneurons_" + std::to_string(i));
+                }
+            }
+        } else { // "flat", the only other mode passing check()
+            flat_ = true;
+            reserve(16);
+            const char *p = prefix_.c_str();
+            branches_.push_back(tree_->Branch((prefix_ + "nJet").c_str(), &n_jets_, TString::Format("%snJet/I", p)));
+            if (store_pt_) {
+                branches_.push_back(
+                    tree_->Branch((prefix_ + "jet_pt").c_str(), pt_.data(), TString::Format("%sjet_pt[%snJet]/F", p, p), /*bufsize=*/102400));
+            }
+            if (store_probs_) {
+                branches_.push_back(tree_->Branch((prefix_ + "jet_probs").c_str(), probs_.data(),
+                                                  TString::Format("%sjet_probs[%snJet][%d]/F", p, p, kNProbs), /*bufsize=*/102400));
+            }
+            if (store_hidneurons_) {
+                TString leaf = TString::Format("%sjet_hidneurons[%snJet][%d]/F", p, p, kNHidNeurons);
+                if (config.hidneuronBits > 0) {
+                    leaf = TString::Format("%sjet_hidneurons[%snJet][%d]/f[0,0,%d]", p, p, kNHidNeurons, config.hidneuronBits);
+                }
+                branches_.push_back(tree_->Branch((prefix_ + "jet_hidneurons").c_str(), hidneurons_.data(), leaf, /*bufsize=*/102400));
+            }
+        }
+    }
+
+    ~OutputWriter() {
+        // only the own branches: other writers may share the tree
+        for (auto *b : branches_) {
+            if (b) {
+                b->ResetAddress();
+            }
+        }
+        for (auto *v : vectors_) {
+            delete v;
+        }
+    }
+
+    void clear() {
+        n_jets_ = 0;
+        for (auto *v : vectors_) {
+            v->clear();
+        }
+    }
+
+    // Add a jet to the current event; `output` holds the 188 probabilities followed by the 128 hidden neurons
+    void add_jet(float pt, const float *output) {
+        if (flat_) {
+            if (n_jets_ == capacity_) {
+                reserve(2 * capacity_);
+            }
+            pt_[n_jets_] = pt;
+            std::copy_n(output, kNProbs, probs_.data() + n_jets_ * kNProbs);
+            std::copy_n(output + kNProbs, kNHidNeurons, hidneurons_.data() + n_jets_ * kNHidNeurons);
+        } else {
+            auto *v = vectors_.data();
+            if (store_pt_) {
+                (*v++)->push_back(pt);
+            }
+            if (store_probs_) {
+                for (int i = 0; i < kNProbs; i++) {
+                    (*v++)->push_back(output[i]);
+                }
+            }
+            if (store_hidneurons_) {
+                for (int i = 0; i < kNHidNeurons; i++) {
+                    (*v++)->push_back(output[kNProbs + i]);
+                }
+            }
+        }
+        ++n_jets_;
+    }
+
+private:
+    TTree *tree_;
+    std::string prefix_;
+    bool flat_ = false;
+    bool store_pt_ = false;
+    bool store_probs_ = false;
+    bool store_hidneurons_ = false;
+    Int_t n_jets_ = 0;
+
+    std::vector<TBranch*> branches_; // booked by this writer
+
+    // vector mode: branch objects in the order jet_pt, jet_probs_*, jet_hidneurons_*
+    std::vector<std::vector<float>*> vectors_;
+
+    // flat mode: per-jet arrays for up to capacity_ jets
+    Int_t capacity_ = 0;
+    std::vector<float> pt_;
+    std::vector<float> probs_;
+    std::vector<float> hidneurons_;
+
+    void book_vector(const std::string &name) {
+        vectors_.push_back(new std::vector<float>);
+        branches_.push_back(tree_->Branch((prefix_ + name).c_str(), &vectors_.back(), /*bufsize=*/102400));
+    }
+
+    // Grow the flat arrays and point the branches to the new buffers
+    void reserve(Int_t n_jets) {
+        capacity_ = n_jets;
+        pt_.resize(capacity_);
+        probs_.resize(capacity_ * kNProbs);
+        hidneurons_.resize(capacity_ * kNHidNeurons);
+        if (auto *b = tree_->GetBranch((prefix_ + "jet_pt").c_str())) {
+            b->SetAddress(pt_.data());
+        }
+        if (auto *b = tree_->GetBranch((prefix_ + "jet_probs").c_str())) {
+            b->SetAddress(probs_.data());
+        }
+        if (auto *b = tree_->GetBranch((prefix_ + "jet_hidneurons").c_str())) {
+            b->SetAddress(hidneurons_.data());
+        }
+    }
+};
+
+#endif
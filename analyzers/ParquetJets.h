@@ -0,0 +1,291 @@
+#ifndef ParquetJets_h
+#define ParquetJets_h
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/util/compression.h>
+#include <arrow/util/key_value_metadata.h>
+#include <parquet/arrow/reader.h>
+#include <parquet/arrow/writer.h>
+#include <parquet/properties.h>
+#include "JetInputs.h"
+#include "ModelOutputs.h"
+
+// Throw on Arrow errors
+inline void checkArrow(const arrow::Status &status, const std::string &what) {
+    if (!status.ok()) {
+        throw std::runtime_error(what + ": " + status.ToString());
+    }
+}
+
+template <class T>
+T checkArrow(arrow::Result<T> result, const std::string &what) {
+    checkArrow(result.status(), what);
+    return std::move(result).ValueUnsafe();
+}
+
+
+// Streaming reader of JetClass-II Parquet files (jet_* columns and part_* list columns, as in
+// notebooks/JetClassII_example.parquet). Only the columns of the model inputs and the requested extra columns are
+// decoded, one record batch of `batchRows` jets at a time. The particle values are taken straight from the
+// contiguous value buffers of the decoded list columns: filling the model inputs of a jet is one copy per variable.
+// part_pid is derived from the particle-type flags and the charge, as in dump_jets.py.
+class ParquetJetReader {
+public:
+    ParquetJetReader(const std::string &path, int64_t batchRows = 8192, const std::vector<std::string> &extraColumns = {}) : path_(path) {
+        parquet::ArrowReaderProperties properties;
+        properties.set_batch_size(batchRows);
+        properties.set_pre_buffer(true);
+        properties.set_use_threads(false); // files are processed in parallel instead
+        parquet::arrow::FileReaderBuilder builder;
+        checkArrow(builder.OpenFile(path), "Cannot open " + path);
+        builder.properties(properties);
+        fileReader_ = checkArrow(builder.Build(), "Cannot read " + path);
+
+        // Leaf columns of the needed fields (a list field has one leaf column)
+        std::vector<std::string> fields = {"jet_pt", "jet_eta", "jet_phi", "jet_energy", "part_isElectron", "part_isMuon", "part_isPhoton"};
+        for (int v = 0; v < kNParticleVars; v++) {
+            if (v != kPartPid) {
+                fields.push_back(kParticleVarNames[v]);
+            }
+        }
+        for (const auto &name : extraColumns) {
+            if (std::find(fields.begin(), fields.end(), name) == fields.end()) {
+                fields.push_back(name);
+            }
+        }
+        const parquet::SchemaDescriptor *schema = fileReader_->parquet_reader()->metadata()->schema();
+        std::vector<int> columns;
+        for (int i = 0; i < schema->num_columns(); i++) {
+            if (std::find(fields.begin(), fields.end(), schema->GetColumnRoot(i)->name()) != fields.end()) {
+                columns.push_back(i);
+            }
+        }
+        std::vector<int> rowGroups(fileReader_->num_row_groups());
+        for (size_t i = 0; i < rowGroups.size(); i++) {
+            rowGroups[i] = i;
+        }
+        batchReader_ = checkArrow(fileReader_->GetRecordBatchReader(rowGroups, columns), "Cannot read " + path);
+        for (const auto &name : fields) {
+            if (batchReader_->schema()->GetFieldIndex(name) < 0) {
+                throw std::runtime_error("Column " + name + " is not found in " + path);
+            }
+        }
+    }
+
+    // Total number of jets in the file
+    int64_t totalRows() const {
+        return fileReader_->parquet_reader()->metadata()->num_rows();
+    }
+
+    // Decode the next record batch; false at the end of the file
+    bool next() {
+        batch_ = checkArrow(batchReader_->Next(), "Cannot read " + path_);
+        if (!batch_) {
+            return false;
+        }
+        jetPt_ = floatValues(batch_->GetColumnByName("jet_pt"), "jet_pt");
+        jetEta_ = floatValues(batch_->GetColumnByName("jet_eta"), "jet_eta");
+        jetPhi_ = floatValues(batch_->GetColumnByName("jet_phi"), "jet_phi");
+        jetEnergy_ = floatValues(batch_->GetColumnByName("jet_energy"), "jet_energy");
+        for (int v = 0; v < kNParticleVars; v++) {
+            if (v != kPartPid && v != kPartCharge) {
+                particles_[v] = floatList(kParticleVarNames[v]);
+            }
+        }
+        charge_ = list<arrow::Int32Array>("part_charge", arrow::int32());
+        isElectron_ = list<arrow::BooleanArray>("part_isElectron", arrow::boolean());
+        isMuon_ = list<arrow::BooleanArray>("part_isMuon", arrow::boolean());
+        isPhoton_ = list<arrow::BooleanArray>("part_isPhoton", arrow::boolean());
+        return true;
+    }
+
+    // Number of jets in the current batch
+    int64_t numRows() const {
+        return batch_ ? batch_->num_rows() : 0;
+    }
+
+    // Column of the current batch (e.g. to pass it on to the output without copying)
+    std::shared_ptr<arrow::Array> column(const std::string &name) const {
+        return batch_->GetColumnByName(name);
+    }
+
+    std::shared_ptr<arrow::Schema> schema() const {
+        return batchReader_->schema();
+    }
+
+    // Fill the model inputs of jet `row` of the current batch: the first particles, up to the model length
+    void fill(int64_t row, JetInputs &jet) const {
+        jet.clear();
+        jet.jet_pt = jetPt_[row];
+        jet.jet_eta = jetEta_[row];
+        jet.jet_phi = jetPhi_[row];
+        jet.jet_energy = jetEnergy_[row];
+
+        const int32_t first = charge_.offsets[row];
+        const int n = std::min<int>(charge_.offsets[row + 1] - first, JetInputs::kMaxParticles);
+        jet.n_particles = n;
+        for (int v = 0; v < kNParticleVars; v++) {
+            if (v != kPartPid && v != kPartCharge) {
+                const auto &column = particles_[v];
+                if (column.offsets[row + 1] - column.offsets[row] != charge_.offsets[row + 1] - first) {
+                    throw std::runtime_error(std::string("Inconsistent particle count in ") + kParticleVarNames[v] + " of " + path_);
+                }
+                std::copy_n(column.values->raw_values() + column.offsets[row], n, jet[(ParticleVar)v]);
+            }
+        }
+        for (const auto *flags : {&isElectron_, &isMuon_, &isPhoton_}) {
+            if (flags->offsets[row + 1] - flags->offsets[row] != charge_.offsets[row + 1] - first) {
+                throw std::runtime_error("Inconsistent particle count in the particle-type flags of " + path_);
+            }
+        }
+        const int32_t *charge = charge_.values->raw_values() + first;
+        float *partCharge = jet[kPartCharge];
+        float *partPid = jet[kPartPid];
+        for (int k = 0; k < n; k++) {
+            const float q = charge[k];
+            float pid = q != 0 ? 211 * q : 130;
+            if (isPhoton_.values->Value(isPhoton_.offsets[row] + k)) {
+                pid = 22;
+            }
+            if (isElectron_.values->Value(isElectron_.offsets[row] + k)) {
+                pid = -11 * q;
+            }
+            if (isMuon_.values->Value(isMuon_.offsets[row] + k)) {
+                pid = -13 * q;
+            }
+            partCharge[k] = q;
+            partPid[k] = pid;
+        }
+    }
+
+private:
+    // List column of the current batch: offsets[row]..offsets[row + 1] index the values of a jet
+    template <class ValueArray>
+    struct ListColumn {
+        const int32_t *offsets = nullptr;
+        std::shared_ptr<ValueArray> values;
+    };
+
+    std::string path_;
+    std::unique_ptr<parquet::arrow::FileReader> fileReader_;
+    std::unique_ptr<arrow::RecordBatchReader> batchReader_;
+    std::shared_ptr<arrow::RecordBatch> batch_;
+    const float *jetPt_ = nullptr, *jetEta_ = nullptr, *jetPhi_ = nullptr, *jetEnergy_ = nullptr;
+    ListColumn<arrow::FloatArray> particles_[kNParticleVars];
+    ListColumn<arrow::Int32Array> charge_;
+    ListColumn<arrow::BooleanArray> isElectron_, isMuon_, isPhoton_;
+
+    const float *floatValues(const std::shared_ptr<arrow::Array> &array, const std::string &name) const {
+        if (array->type_id() != arrow::Type::FLOAT) {
+            throw std::runtime_error("Column " + name + " of " + path_ + " has type " + array->type()->ToString() + ", expected float");
+        }
+        return std::static_pointer_cast<arrow::FloatArray>(array)->raw_values();
+    }
+
+    template <class ValueArray>
+    ListColumn<ValueArray> list(const std::string &name, const std::shared_ptr<arrow::DataType> &valueType) const {
+        auto array = batch_->GetColumnByName(name);
+        if (array->type_id() != arrow::Type::LIST || !std::static_pointer_cast<arrow::ListArray>(array)->value_type()->Equals(valueType)) {
+            throw std::runtime_error("Column " + name + " of " + path_ + " has type " + array->type()->ToString() + ", expected list<" +
+                                     valueType->ToString() + ">");
+        }
+        auto listArray = std::static_pointer_cast<arrow::ListArray>(array);
+        ListColumn<ValueArray> column;
+        column.offsets = listArray->raw_value_offsets();
+        column.values = std::static_pointer_cast<ValueArray>(listArray->values());
+        return column;
+    }
+
+    ListColumn<arrow::FloatArray> floatList(const std::string &name) const {
+        return list<arrow::FloatArray>(name, arrow::float32());
+    }
+};
+
+
+// Writes the model outputs as a Parquet file: the passed-on input columns (e.g. jet_pt, jet_label) followed by
+// jet_probs (kNProbs floats per jet) and/or jet_hidneurons (kNHidNeurons floats per jet) as fixed-size lists
+class ParquetScoreWriter {
+public:
+    // keepFields: fields of the input columns passed to write(); metadata: stored in the schema (e.g. the model)
+    ParquetScoreWriter(const std::string &path, const std::vector<std::shared_ptr<arrow::Field>> &keepFields, bool storeProbs,
+                       bool storeHidNeurons, const std::vector<std::pair<std::string, std::string>> &metadata = {})
+        : path_(path), nKeep_(keepFields.size()), storeProbs_(storeProbs), storeHidNeurons_(storeHidNeurons) {
+        auto fields = keepFields;
+        if (storeProbs_) {
+            fields.push_back(arrow::field("jet_probs", arrow::fixed_size_list(arrow::float32(), kNProbs), false));
+        }
+        if (storeHidNeurons_) {
+            fields.push_back(arrow::field("jet_hidneurons", arrow::fixed_size_list(arrow::float32(), kNHidNeurons), false));
+        }
+        auto keyValues = std::make_shared<arrow::KeyValueMetadata>();
+        for (const auto &kv : metadata) {
+            keyValues->Append(kv.first, kv.second);
+        }
+        schema_ = arrow::schema(fields, keyValues);
+
+        parquet::WriterProperties::Builder properties;
+        properties.compression(arrow::util::Codec::IsAvailable(arrow::Compression::ZSTD) ? arrow::Compression::ZSTD
+                                                                                         : arrow::Compression::UNCOMPRESSED);
+        auto sink = checkArrow(arrow::io::FileOutputStream::Open(path_), "Cannot write " + path_);
+        writer_ = checkArrow(parquet::arrow::FileWriter::Open(*schema_, arrow::default_memory_pool(), sink, properties.build(),
+                                                              parquet::ArrowWriterProperties::Builder().store_schema()->build()),
+                             "Cannot write " + path_);
+    }
+
+    ~ParquetScoreWriter() {
+        if (writer_) {
+            writer_->Close().ok();
+        }
+    }
+
+    // Write `nJets` jets: the passed-on columns (in the order of keepFields, `nJets` rows each) and the model outputs,
+    // `outputSize` values per jet starting with the 188 probabilities and the 128 hidden neurons
+    void write(const std::vector<std::shared_ptr<arrow::Array>> &keepColumns, const float *outputs, int64_t nJets, size_t outputSize) {
+        if (keepColumns.size() != nKeep_) {
+            throw std::runtime_error("Expected " + std::to_string(nKeep_) + " passed-on columns for " + path_);
+        }
+        if (outputSize < (size_t)kNProbs + (storeHidNeurons_ ? kNHidNeurons : 0)) {
+            throw std::runtime_error("The model has " + std::to_string(outputSize) + " outputs per jet, too few for " + path_);
+        }
+        auto columns = keepColumns;
+        if (storeProbs_) {
+            columns.push_back(fixedSizeList(outputs, 0, kNProbs, nJets, outputSize));
+        }
+        if (storeHidNeurons_) {
+            columns.push_back(fixedSizeList(outputs, kNProbs, kNHidNeurons, nJets, outputSize));
+        }
+        checkArrow(writer_->WriteRecordBatch(*arrow::RecordBatch::Make(schema_, nJets, columns)), "Cannot write " + path_);
+    }
+
+    void close() {
+        checkArrow(writer_->Close(), "Cannot write " + path_);
+        writer_.reset();
+    }
+
+private:
+    std::string path_;
+    size_t nKeep_;
+    bool storeProbs_;
+    bool storeHidNeurons_;
+    std::shared_ptr<arrow::Schema> schema_;
+    std::unique_ptr<parquet::arrow::FileWriter> writer_;
+
+    // Values [first, first + size) of every jet's outputs as a fixed-size list array
+    std::shared_ptr<arrow::Array> fixedSizeList(const float *outputs, size_t first, int size, int64_t nJets, size_t outputSize) const {
+        auto buffer = checkArrow(arrow::AllocateBuffer(nJets * size * sizeof(float)), "Cannot allocate the outputs");
+        float *values = reinterpret_cast<float *>(buffer->mutable_data());
+        for (int64_t j = 0; j < nJets; j++) {
+            std::copy_n(outputs + j * outputSize + first, size, values + j * size);
+        }
+        auto valueArray = std::make_shared<arrow::FloatArray>(nJets * size, std::shared_ptr<arrow::Buffer>(std::move(buffer)));
+        return checkArrow(arrow::FixedSizeListArray::FromArrays(valueArray, size), "Cannot build the outputs");
+    }
+};
+
+#endif
@@ -14,52 +14,15 @@ double deltaR(const T1 &a, const T2 &b) {
   return deltaR(a->Eta, a->Phi, b->Eta, b->Phi);
 }
 
+// Compact record of the constituent fields consumed by the model
 struct ParticleInfo {
-  ParticleInfo(const GenParticle *particle) {
-    pt = particle->PT;
-    eta = particle->Eta;
-    phi = particle->Phi;
-    mass = particle->Mass;
-    p4 = ROOT::Math::PtEtaPhiMVector(pt, eta, phi, mass);
-    px = p4.px();
-    py = p4.py();
-    pz = p4.pz();
-    energy = p4.energy();
-    charge = particle->Charge;
-    pid = particle->PID;
-    x = particle->X;
-    y = particle->Y;
-    z = particle->Z;
-    t = particle->T;
-  }
-
-  ParticleInfo(const ParticleFlowCandidate *particle) {
-    pt = particle->PT;
-    eta = particle->Eta;
-    phi = particle->Phi;
-    mass = particle->Mass;
-    p4 = ROOT::Math::PtEtaPhiMVector(pt, eta, phi, mass);
-    px = p4.px();
-    py = p4.py();
-    pz = p4.pz();
-    energy = p4.energy();
-    charge = particle->Charge;
-    pid = particle->PID;
-    d0 = particle->D0;
-    d0err = particle->ErrorD0;
-    dz = particle->DZ;
-    dzerr = particle->ErrorDZ;
-  }
-
-  double pt;
-  double eta;
-  double phi;
-  double mass;
-  double px;
-  double py;
-  double pz;
-  double energy;
-  ROOT::Math::PtEtaPhiMVector p4;
+  float pt;
+  float eta;
+  float phi;
+  float px;
+  float py;
+  float pz;
+  float energy;
 
   int charge;
   int pid;
@@ -68,11 +31,60 @@ struct ParticleInfo {
   float d0err = 0;
   float dz = 0;
   float dzerr = 0;
-
-  float x = 0;
-  float y = 0;
-  float z = 0;
-  float t = 0;
 };
 
+// Fill the kinematics of `p` from a Delphes particle.
+// Returns false, without filling the remaining fields, if the particle fails the |pz| > 10000, |eta| > 5 or pt <= 0 cuts.
+template <class T>
+bool fillKinematics(ParticleInfo &p, const T *particle) {
+  if (std::abs(particle->Eta) > 5 || particle->PT <= 0) {
+    return false;
+  }
+  ROOT::Math::PtEtaPhiMVector p4(particle->PT, particle->Eta, particle->Phi, particle->Mass);
+  if (std::abs(p4.pz()) > 10000) {
+    return false;
+  }
+  p.pt = particle->PT;
+  p.eta = particle->Eta;
+  p.phi = particle->Phi;
+  p.px = p4.px();
+  p.py = p4.py();
+  p.pz = p4.pz();
+  p.energy = p4.energy();
+  p.charge = particle->Charge;
+  p.pid = particle->PID;
+  return true;
+}
+
+inline bool fillParticle(ParticleInfo &p, const GenParticle *particle) {
+  if (!fillKinematics(p, particle)) {
+    return false;
+  }
+  p.d0 = p.d0err = p.dz = p.dzerr = 0;
+  return true;
+}
+
+inline bool fillParticle(ParticleInfo &p, const ParticleFlowCandidate *particle) {
+  if (!fillKinematics(p, particle)) {
+    return false;
+  }
+  p.d0 = particle->D0;
+  p.d0err = particle->ErrorD0;
+  p.dz = particle->DZ;
+  p.dzerr = particle->ErrorDZ;
+  return true;
+}
+
+// Order `particles` so that the (up to) `k` leading ones by pt come first, sorted by decreasing pt.
+// Returns the number of selected particles; the order of the remaining ones is unspecified.
+inline size_t selectLeading(std::vector<ParticleInfo> &particles, size_t k) {
+  auto byPt = [](const ParticleInfo &a, const ParticleInfo &b) { return a.pt > b.pt; };
+  if (particles.size() > k) {
+    std::partial_sort(particles.begin(), particles.begin() + k, particles.end(), byPt);
+    return k;
+  }
+  std::sort(particles.begin(), particles.end(), byPt);
+  return particles.size();
+}
+
 #endif
@@ -0,0 +1,150 @@
+#ifndef Pipeline_h
+#define Pipeline_h
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Wait strategy for a blocked pipeline stage: spin briefly, then yield, then sleep, so that an idle stage does not
+// keep a core busy while its neighbour is the bottleneck
+class Backoff {
+public:
+    void wait() {
+        if (n_waits_ < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else if (n_waits_ < 128) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        ++n_waits_;
+    }
+
+private:
+    unsigned n_waits_ = 0;
+};
+
+// Bounded lock-free queue between one producer and one consumer thread (pipeline stages). push() blocks while the
+// queue is full, which propagates backpressure to the upstream stage; pop() blocks while it is empty.
+// close(): no more elements will be pushed; pop() returns false once the queue is drained.
+// abort(): stop both sides, e.g. after an error in another stage; push() and pop() return false.
+template <class T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) {
+        capacity_ = 1;
+        while (capacity_ < capacity) {
+            capacity_ *= 2;
+        }
+        mask_ = capacity_ - 1;
+        buffer_.resize(capacity_);
+    }
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side
+    bool try_push(T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ == capacity_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ == capacity_) {
+                return false;
+            }
+        }
+        buffer_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool push(T value) {
+        if (try_push(value)) {
+            return true;
+        }
+        ++push_waits_;
+        Backoff backoff;
+        while (!try_push(value)) {
+            if (aborted_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            backoff.wait();
+        }
+        return true;
+    }
+
+    void close() {
+        closed_.store(true, std::memory_order_release);
+    }
+
+    // Consumer side
+    bool try_pop(T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_) {
+                return false;
+            }
+        }
+        value = std::move(buffer_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        if (try_pop(value)) {
+            return true;
+        }
+        ++pop_waits_;
+        Backoff backoff;
+        while (!try_pop(value)) {
+            if (aborted_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (closed_.load(std::memory_order_acquire)) {
+                // everything pushed before close() is visible now
+                return try_pop(value);
+            }
+            backoff.wait();
+        }
+        return true;
+    }
+
+    void abort() {
+        aborted_.store(true, std::memory_order_release);
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+    // Number of push()/pop() calls that had to wait for a full/empty queue; only valid once both sides have stopped
+    size_t push_waits() const {
+        return push_waits_;
+    }
+
+    size_t pop_waits() const {
+        return pop_waits_;
+    }
+
+private:
+    // consumer state
+    alignas(64) std::atomic<size_t> head_{0};
+    size_t tail_cache_ = 0;
+    size_t pop_waits_ = 0;
+    // producer state
+    alignas(64) std::atomic<size_t> tail_{0};
+    size_t head_cache_ = 0;
+    size_t push_waits_ = 0;
+
+    alignas(64) std::atomic<bool> closed_{false};
+    std::atomic<bool> aborted_{false};
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    std::vector<T> buffer_;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef StringUtils_h
+#define StringUtils_h
+
+#include <memory>
+#include <vector>
+#include "TObjArray.h"
+#include "TObjString.h"
+#include "TString.h"
+
+// Stripped, non-empty entries of a list separated by any of the characters of `delim`, e.g. the comma-separated
+// arguments of the macros
+std::vector<TString> splitList(const TString &list, const char *delim = ",") {
+    std::vector<TString> items;
+    std::unique_ptr<TObjArray> tokens(list.Tokenize(delim));
+    for (const auto *obj : *tokens) {
+        TString item = ((const TObjString *)obj)->String().Strip(TString::kBoth);
+        if (item != "") {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#!/usr/bin/env python
+"""Convert JetClass-II parquet files to a flat ROOT tree of model inputs for benchmark.C.
+
+The tree `jets` has one entry per jet with jet_pt, jet_eta, jet_phi, jet_energy and the variable-length float arrays
+part_px, ..., part_dzerr; part_pid is derived from the particle-type flags.
+
+    python dump_jets.py ../notebooks/JetClassII_example.parquet jets.root
+"""
+
+import argparse
+
+import awkward as ak
+import numpy as np
+import uproot
+
+PART_VARS = ['part_px', 'part_py', 'part_pz', 'part_energy', 'part_deta', 'part_dphi',
+             'part_charge', 'part_pid', 'part_d0val', 'part_d0err', 'part_dzval', 'part_dzerr']
+
+
+def particle_pid(table):
+    charge = table['part_charge']
+    pid = ak.where(charge != 0, 211 * charge, 130)
+    pid = ak.where(table['part_isPhoton'], 22, pid)
+    pid = ak.where(table['part_isElectron'], -11 * charge, pid)
+    pid = ak.where(table['part_isMuon'], -13 * charge, pid)
+    return pid
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('inputs', nargs='+', help='input parquet files')
+    parser.add_argument('output', help='output ROOT file')
+    parser.add_argument('--max-jets', type=int, default=-1, help='maximum number of jets to convert (default: all)')
+    args = parser.parse_args()
+
+    table = ak.concatenate([ak.from_parquet(path) for path in args.inputs])
+    if args.max_jets >= 0:
+        table = table[:args.max_jets]
+
+    particles = {var[len('part_'):]: table[var] for var in PART_VARS if var != 'part_pid'}
+    particles['pid'] = particle_pid(table)
+    particles = {name: ak.values_astype(values, np.float32) for name, values in particles.items()}
+
+    with uproot.recreate(args.output) as fout:
+        # the zipped record is written as the branches part_<name> with the counter npart
+        fout['jets'] = {
+            **{var: ak.values_astype(table[var], np.float32) for var in ['jet_pt', 'jet_eta', 'jet_phi', 'jet_energy']},
+            'part': ak.zip(particles),
+        }
+    print(f'wrote {len(table)} jets to {args.output}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,298 @@
+#!/usr/bin/env python
+"""Generate FeatureSchema.h, the compile-time description of the model inputs, from a weaver data config.
+
+The `inputs` section gives the channels of the three model inputs fed by OrtHelper (features, vectors and mask, in
+this order) with their normalization; the `new_variables` section gives the formulas of the derived variables. Both
+are translated into C++: channel enums, normalization constants and a per-particle kernel with the formulas and
+constants written out, which is the reference implementation of the feature kernels (FeatureKernel.h).
+
+    python generate_schema.py ../data/JetClassII/JetClassII_full.yaml -o FeatureSchema.h
+
+Regenerate the header whenever the data config of the model changes.
+"""
+
+import argparse
+import ast
+import math
+import os
+
+import yaml
+
+# Variables read from JetInputs: the particle columns (ParticleVar) and the jet members
+PARTICLE_VARS = {
+    'part_px': 'kPartPx',
+    'part_py': 'kPartPy',
+    'part_pz': 'kPartPz',
+    'part_energy': 'kPartEnergy',
+    'part_deta': 'kPartDeta',
+    'part_dphi': 'kPartDphi',
+    'part_charge': 'kPartCharge',
+    'part_pid': 'kPartPid',
+    'part_d0val': 'kPartD0val',
+    'part_d0err': 'kPartD0err',
+    'part_dzval': 'kPartDzval',
+    'part_dzerr': 'kPartDzerr',
+}
+JET_VARS = ['jet_pt', 'jet_eta', 'jet_phi', 'jet_energy']
+
+# Columns of the JetClass-II files that the analyzers derive from the particle ID (same as dump_jets.py)
+BUILTIN_VARS = {
+    'part_isElectron': 'np.abs(part_pid) == 11',
+    'part_isMuon': 'np.abs(part_pid) == 13',
+    'part_isPhoton': 'part_pid == 22',
+    'part_isChargedHadron': '(part_charge != 0) & ~part_isElectron & ~part_isMuon',
+    'part_isNeutralHadron': '(part_charge == 0) & ~part_isPhoton',
+}
+
+FUNCTIONS = {
+    'abs': 'std::abs', 'hypot': 'std::hypot', 'log': 'std::log', 'log1p': 'std::log1p', 'exp': 'std::exp',
+    'sqrt': 'std::sqrt', 'tanh': 'std::tanh', 'sin': 'std::sin', 'cos': 'std::cos', 'arctan2': 'std::atan2',
+    'minimum': 'std::min', 'maximum': 'std::max',
+}
+BINARY_OPS = {ast.Add: '+', ast.Sub: '-', ast.Mult: '*', ast.Div: '/', ast.BitAnd: '&&', ast.BitOr: '||'}
+COMPARE_OPS = {ast.Eq: '==', ast.NotEq: '!=', ast.Lt: '<', ast.LtE: '<=', ast.Gt: '>', ast.GtE: '>='}
+
+# Model inputs fed by OrtHelper, with the prefix of their channel enums
+ROLES = [('features', 'kFeat'), ('vectors', 'kVec'), ('mask', None)]
+
+
+def float_literal(value):
+    value = float(value)
+    if math.isinf(value):
+        return '-kInf' if value < 0 else 'kInf'
+    text = repr(value)  # shortest round-trip form, e.g. 500.0, 1.7, 1e-08
+    if text.endswith('.0'):
+        text = text[:-1]
+    return text + 'f'
+
+
+class Translator:
+    """Translate the (numpy) formulas of the data config into C++ expressions on floats."""
+
+    def __init__(self, formulas):
+        self.formulas = formulas
+        self.order = []  # derived variables in evaluation order
+        self.code = {}
+        self.inputs = set()  # JetInputs variables used
+        self._visiting = set()
+
+    def require(self, name):
+        if name in self.code or name in self.inputs:
+            return
+        if name in PARTICLE_VARS or name in JET_VARS:
+            self.inputs.add(name)
+            return
+        if name not in self.formulas:
+            raise ValueError(f'variable {name} is neither defined in new_variables nor available from JetInputs')
+        if name in self._visiting:
+            raise ValueError(f'circular definition of {name}')
+        self._visiting.add(name)
+        self.code[name] = self.expr(ast.parse(str(self.formulas[name]), mode='eval').body, name)
+        self._visiting.discard(name)
+        self.order.append(name)
+
+    def expr(self, node, name):
+        if isinstance(node, ast.Name):
+            self.require(node.id)
+            return node.id
+        if isinstance(node, ast.Constant) and isinstance(node.value, (int, float)) and not isinstance(node.value, bool):
+            return float_literal(node.value)
+        if isinstance(node, ast.BinOp) and type(node.op) in BINARY_OPS:
+            return f'({self.expr(node.left, name)} {BINARY_OPS[type(node.op)]} {self.expr(node.right, name)})'
+        if isinstance(node, ast.UnaryOp) and isinstance(node.op, ast.USub):
+            return f'(-{self.expr(node.operand, name)})'
+        if isinstance(node, ast.UnaryOp) and isinstance(node.op, (ast.Invert, ast.Not)):
+            return f'(!{self.expr(node.operand, name)})'
+        if isinstance(node, ast.Compare) and len(node.ops) == 1 and type(node.ops[0]) in COMPARE_OPS:
+            return f'({self.expr(node.left, name)} {COMPARE_OPS[type(node.ops[0])]} {self.expr(node.comparators[0], name)})'
+        if isinstance(node, ast.Call) and isinstance(node.func, ast.Attribute) and isinstance(node.func.value, ast.Name):
+            module, func = node.func.value.id, node.func.attr
+            if module == 'ak' and func in ('ones_like', 'zeros_like') and len(node.args) == 1:
+                return '1.f' if func == 'ones_like' else '0.f'
+            if module in ('np', 'math') and func in FUNCTIONS:
+                args = ', '.join(self.expr(arg, name) for arg in node.args)
+                return f'{FUNCTIONS[func]}({args})'
+        raise ValueError(f'cannot translate the formula of {name}: {ast.unparse(node)}')
+
+
+def enum_name(prefix, var):
+    name = var[len('part_'):] if var.startswith('part_') else var
+    return prefix + ''.join(piece[:1].upper() + piece[1:] for piece in name.split('_'))
+
+
+def parse_channel(entry, method):
+    """(name, normalization) of an `inputs` entry; normalization is (subtract, multiply, clip_min, clip_max) or None"""
+    if isinstance(entry, str):
+        entry = [entry]
+    name, params = entry[0], list(entry[1:]) + [None] * (5 - len(entry[1:]))
+    subtract, multiply, clip_min, clip_max, pad_value = params[:5]
+    if pad_value not in (None, 0):
+        raise ValueError(f'{name}: pad_value {pad_value} is not supported, the padding is zero')
+    if subtract is None:
+        if method != 'manual':
+            raise ValueError(f'{name}: automatic standardization is not supported, set the parameters in the config')
+        return name, None
+    return name, (float(subtract), 1. if multiply is None else float(multiply),
+                  -5. if clip_min is None else float(clip_min), 5. if clip_max is None else float(clip_max))
+
+
+def fnv1a(text):
+    h = 0xcbf29ce484222325
+    for byte in text.encode():
+        h = ((h ^ byte) * 0x100000001b3) & 0xffffffffffffffff
+    return h
+
+
+def scale_code(value, norm):
+    if norm is None:
+        return value
+    subtract, multiply, clip_min, clip_max = norm
+    if subtract != 0:
+        value = f'({value} - {float_literal(subtract)})' if subtract > 0 else f'({value} + {float_literal(-subtract)})'
+    if multiply != 1:
+        value = f'{value} * {float_literal(multiply)}'
+    return f'std::clamp({value}, {float_literal(clip_min)}, {float_literal(clip_max)})'
+
+
+def generate(config_path, input_names):
+    with open(config_path) as f:
+        config = yaml.safe_load(f)
+    method = config.get('preprocess', {}).get('method', 'manual')
+    formulas = dict(BUILTIN_VARS)
+    formulas.update(config.get('new_variables') or {})
+    translator = Translator(formulas)
+
+    roles = []
+    length = None
+    for (role, prefix), input_name in zip(ROLES, input_names):
+        if input_name not in config['inputs']:
+            raise ValueError(f'input {input_name} is not in the data config')
+        spec = config['inputs'][input_name]
+        if length is not None and spec['length'] != length:
+            raise ValueError('all inputs must have the same length')
+        length = spec['length']
+        channels = [parse_channel(entry, method) for entry in spec['vars']]
+        if role == 'mask' and len(channels) != 1:
+            raise ValueError(f'the mask input {input_name} must have one channel')
+        for name, _ in channels:
+            translator.require(name)
+        roles.append((role, prefix, input_name, channels))
+
+    # the formula hash identifies the computed channels; the normalization constants are not part of it
+    signature = ';'.join(f'{input_name}:' + ','.join(name for name, _ in channels) for _, _, input_name, channels in roles)
+    signature += '|' + ';'.join(f'{name}={translator.code[name]}' for name in translator.order)
+    formula_hash = fnv1a(signature)
+
+    features, vectors, mask = roles
+    all_channels = features[3] + vectors[3] + mask[3]
+    lines = []
+    out = lines.append
+    out(f'// Generated by generate_schema.py from {os.path.relpath(config_path, os.path.dirname(os.path.abspath(__file__)))}; do not edit.')
+    out('// Model inputs (channels, normalization and derived-variable formulas) as compile-time constants.')
+    out('')
+    out('#ifndef FeatureSchema_h')
+    out('#define FeatureSchema_h')
+    out('')
+    out('#include <algorithm>')
+    out('#include <cmath>')
+    out('#include <cstdint>')
+    out('#include <limits>')
+    out('')
+    out('#include "JetInputs.h"')
+    out('')
+    out('// Identifies the input channels and formulas (not the normalization), for kernels written for one schema')
+    out(f'#define FEATURE_SCHEMA_FORMULA_HASH 0x{formula_hash:016x}ull')
+    out('')
+    counts = ', '.join(f'{input_name} ({len(channels)})' for _, _, input_name, channels in roles)
+    out(f'// Channels of the ParT inputs: {counts}')
+    for role, prefix, input_name, channels in roles[:2]:
+        enum = 'FeatureChannel' if role == 'features' else 'VectorChannel'
+        count = 'kNFeatures' if role == 'features' else 'kNVectors'
+        names = [enum_name(prefix, name) for name, _ in channels] + [count]
+        out(f'enum {enum} {{')
+        for i in range(0, len(names), 6):
+            out('    ' + ', '.join(names[i:i + 6]) + (',' if i + 6 < len(names) else ''))
+        out('};')
+    out('')
+    out('namespace feature_schema {')
+    out('')
+    out('  // Model input names, ordered as (features, vectors, mask)')
+    out('  constexpr const char* kInputNames[3] = {' + ', '.join(f'"{name}"' for _, _, name, _ in roles) + '};')
+    out('')
+    out('  // Model particle length')
+    out(f'  constexpr int kLength = {length};')
+    out('  static_assert(kLength <= JetInputs::kMaxParticles, "JetInputs holds fewer particles than the model length");')
+    out('')
+    out('  // Flat index of a channel: features, then vectors, then the mask')
+    out('  constexpr int kVectorOffset = kNFeatures;')
+    out('  constexpr int kMaskOffset = int(kNFeatures) + kNVectors;')
+    out('  constexpr int kNChannels = kMaskOffset + 1;')
+    out('')
+    out('  constexpr const char* kChannelNames[kNChannels] = {')
+    names = [f'"{name}"' for name, _ in all_channels]
+    for i in range(0, len(names), 6):
+        out('    ' + ', '.join(names[i:i + 6]) + (',' if i + 6 < len(names) else ''))
+    out('  };')
+    out('')
+    out('  constexpr float kInf = std::numeric_limits<float>::infinity();')
+    out('')
+    out('  // Normalization of every channel: clamp((x - subtract) * multiply, clip_min, clip_max); channels without')
+    out('  // normalization in the data config have an unbounded range')
+    inf = float('inf')
+    for array, index, default in [('kSubtract', 0, 0.), ('kMultiply', 1, 1.), ('kClipMin', 2, -inf), ('kClipMax', 3, inf)]:
+        values = [float_literal(norm[index] if norm else default) for _, norm in all_channels]
+        out(f'  constexpr float {array}[kNChannels] = {{' + ', '.join(values) + '};')
+    out('')
+    out('  // Normalized inputs of the first min(jet.n_particles, length) particles of `jet`, written into the zero-initialized')
+    out('  // (channel, length) rows `features`, `vectors` and `mask`')
+    out('  inline void transform(const JetInputs& jet, int length, float* features, float* vectors, float* mask) {')
+    for name in JET_VARS:
+        if name in translator.inputs:
+            out(f'    const float {name} = jet.{name};')
+    out('    const int len = std::min(length, jet.n_particles);')
+    out('    for (int l = 0; l < len; l++) { // loop over particle length')
+    for name, var in PARTICLE_VARS.items():
+        if name in translator.inputs:
+            out(f'      const float {name} = jet[{var}][l];')
+    out('')
+    out('      // new variables')
+    for name in translator.order:
+        out(f'      const float {name} = {translator.code[name]};')
+    out('')
+    for role, prefix, input_name, channels in roles:
+        out(f'      // {input_name}')
+        for i, (name, norm) in enumerate(channels):
+            if role == 'mask':
+                out(f'      mask[l] = {scale_code(name, norm)};')
+            else:
+                out(f'      {role}[{enum_name(prefix, name)} * length + l] = {scale_code(name, norm)};')
+    out('    }')
+    out('  }')
+    out('')
+    out('}  // namespace feature_schema')
+    out('')
+    out('#endif')
+    return '\n'.join(lines) + '\n'
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('config', nargs='?', default=os.path.join(here, '..', 'data', 'JetClassII', 'JetClassII_full.yaml'),
+                        help='weaver data config (default: %(default)s)')
+    parser.add_argument('-o', '--output', default=os.path.join(here, 'FeatureSchema.h'), help='output header (default: %(default)s)')
+    parser.add_argument('--inputs', default='pf_features,pf_vectors,pf_mask',
+                        help='names of the features, vectors and mask inputs in the config (default: %(default)s)')
+    args = parser.parse_args()
+
+    input_names = args.inputs.split(',')
+    if len(input_names) != 3:
+        parser.error('--inputs needs the features, vectors and mask input names')
+    text = generate(os.path.normpath(args.config), input_names)
+    with open(args.output, 'w') as f:
+        f.write(text)
+    print(f'wrote {args.output}')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+"""Produce a reduced-precision variant of the exported Sophon ONNX model for the C++ analyzers.
+
+int8: weights of the MatMul/Gemm nodes quantized to INT8, activations quantized on the fly (dynamic quantization);
+      the model inputs and outputs stay float32.
+fp16: weights and activations in float16; the inputs and outputs become float16 too unless --keep-io-types is given
+      (myOrt::ONNXRuntime converts the float buffers either way).
+
+    python quantize_model.py model.onnx model.int8.onnx --mode int8
+    python quantize_model.py model.onnx model.fp16.onnx --mode fp16
+
+Compare the outputs with the float32 model (validate_model.C) before using the result.
+"""
+
+import argparse
+import os
+import tempfile
+
+import onnx
+import onnxruntime as ort
+
+
+def quantize_int8(args):
+    from onnxruntime.quantization import QuantType, quantize_dynamic
+    from onnxruntime.quantization.shape_inference import quant_pre_process
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        model_path = args.input
+        if not args.skip_preprocess:
+            # shape inference and graph optimization, so that the quantizer sees the fused MatMul/Gemm nodes
+            model_path = os.path.join(tmpdir, 'preprocessed.onnx')
+            quant_pre_process(args.input, model_path)
+        quantize_dynamic(
+            model_path,
+            args.output,
+            op_types_to_quantize=args.op_types.split(','),
+            per_channel=args.per_channel,
+            reduce_range=args.reduce_range,
+            weight_type=QuantType.QInt8 if args.weight_type == 'int8' else QuantType.QUInt8,
+            nodes_to_exclude=args.exclude_nodes.split(',') if args.exclude_nodes else None,
+        )
+
+
+def convert_fp16(args):
+    from onnxruntime.transformers.float16 import convert_float_to_float16
+
+    model = onnx.load(args.input)
+    model = convert_float_to_float16(
+        model,
+        keep_io_types=args.keep_io_types,
+        op_block_list=args.op_block_list.split(',') if args.op_block_list else None,
+        node_block_list=args.exclude_nodes.split(',') if args.exclude_nodes else None,
+    )
+    onnx.save(model, args.output)
+
+
+def describe(path):
+    sess = ort.InferenceSession(path, providers=['CPUExecutionProvider'])
+    size = os.path.getsize(path) / 2**20
+    print(f'{path}: {size:.1f} MB')
+    for node in sess.get_inputs():
+        print(f'  input  {node.name}: {node.type} {node.shape}')
+    for node in sess.get_outputs():
+        print(f'  output {node.name}: {node.type} {node.shape}')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', help='float32 ONNX model')
+    parser.add_argument('output', help='output ONNX model')
+    parser.add_argument('--mode', choices=['int8', 'fp16'], required=True, help='target precision')
+    parser.add_argument('--exclude-nodes', default='', help='comma-separated names of nodes to keep in float32')
+    int8 = parser.add_argument_group('int8')
+    int8.add_argument('--op-types', default='MatMul,Gemm', help='comma-separated operator types to quantize (default: %(default)s)')
+    int8.add_argument('--weight-type', choices=['int8', 'uint8'], default='int8', help='weight data type (default: %(default)s)')
+    int8.add_argument('--per-channel', action='store_true', help='quantize the weights per output channel')
+    int8.add_argument('--reduce-range', action='store_true', help='7-bit weights, avoids saturation on CPUs without VNNI')
+    int8.add_argument('--skip-preprocess', action='store_true', help='do not run the shape inference and graph optimization first')
+    fp16 = parser.add_argument_group('fp16')
+    fp16.add_argument('--keep-io-types', action='store_true', help='keep float32 inputs and outputs')
+    fp16.add_argument('--op-block-list', default='', help='comma-separated operator types to keep in float32 '
+                                                          '(default: the onnxruntime list of ops without float16 kernels)')
+    args = parser.parse_args()
+
+    if args.mode == 'int8':
+        quantize_int8(args)
+    else:
+        convert_fp16(args)
+
+    describe(args.input)
+    describe(args.output)
+
+
+if __name__ == '__main__':
+    main()
@@ -20,7 +20,7 @@ fi
 
 # run mode
 MODE=$1
-[[ -z $MODE ]] && echo "Usage: $0 [make_weight|train|convert]" && exit 1
+[[ -z $MODE ]] && echo "Usage: $0 [make_weight|train|convert|quantize]" && exit 1
 
 # default configurations
 epochs=80
@@ -77,7 +77,13 @@ elif [[ $MODE == "convert" ]]; then
         --export-onnx model.onnx \
         "${@:2}"
 
+elif [[ $MODE == "quantize" ]]; then
+    # reduced-precision variants of the converted model for CPU inference; extra args go to quantize_model.py.
+    # Check them against model.onnx with analyzers/validate_model.C before use
+    python analyzers/quantize_model.py model.onnx model.int8.onnx --mode int8 "${@:2}"
+    python analyzers/quantize_model.py model.onnx model.fp16.onnx --mode fp16 "${@:2}"
+
 else
-    echo "Usage: $0 [make_weight|train|convert]"
+    echo "Usage: $0 [make_weight|train|convert|quantize]"
     exit 1
 fi